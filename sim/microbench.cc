@@ -0,0 +1,470 @@
+// microbench: time the predictor components in isolation and the whole
+// PREDICTOR on synthetic branch streams and on slices of real traces.
+// Results are ns per branch, printed as CSV; a CSV from an earlier build
+// can be given with -compare to see the change per benchmark.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+#include "utils.h"
+#include "tracer.h"
+#include "predictor.h"
+
+
+// usage: microbench [options]
+//   -n <branches>   branches per stream (default 1000000)
+//   -r <runs>       runs per benchmark, the best is reported (default 5)
+//   -s <spec>       predictor configuration, key=value[,...]; repeat to
+//                   compare configurations (default: the defaults)
+//   -t <trace>      add a stream replaying the first <branches>
+//                   conditional branches of a trace
+//   -f <text>       only benchmarks whose name contains <text>
+//   -o <file>       also write the CSV to <file>
+//   -compare <file> CSV of an earlier run to compare against
+//
+// CSV columns: benchmark,stream,ns_per_op,config (with -compare:
+// benchmark,stream,ns_per_op,base_ns_per_op,change_pct,config). Commas
+// in a -t stream name, as in synth: specs, are written as ';'.
+
+#define MICROBENCH_BRANCHES 1000000
+#define MICROBENCH_RUNS 5
+#define MICROBENCH_STATIC_BRANCHES 4096
+
+struct BENCH_BRANCH {
+  UINT32 PC;
+  bool taken;
+};
+
+struct BENCH_STREAM {
+  std::string name;
+  std::vector<BENCH_BRANCH> branches;
+};
+
+// Small LCG so the streams are the same on every build
+static UINT32 NextSeed(UINT32 *seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+static UINT32 StaticPC(UINT32 b) { return 0x400000 + b * 12; }
+
+// Loops of assorted trip counts, mostly walked in order
+static BENCH_STREAM LoopStream(UINT32 n) {
+  BENCH_STREAM s = {"loops", std::vector<BENCH_BRANCH>(n)};
+  std::vector<UINT32> period(MICROBENCH_STATIC_BRANCHES);
+  std::vector<UINT32> count(MICROBENCH_STATIC_BRANCHES, 0);
+  UINT32 seed = 12345;
+
+  for (UINT32 b = 0; b < MICROBENCH_STATIC_BRANCHES; b++) {
+    period[b] = NextSeed(&seed) % 32 + 1;
+  }
+
+  UINT32 b = 0;
+  for (UINT32 i = 0; i < n; i++) {
+    UINT32 r = NextSeed(&seed);
+    // mostly walk the code in order, sometimes jump
+    b = (r % 8 == 0) ? (r >> 3) % MICROBENCH_STATIC_BRANCHES
+                     : (b + 1) % MICROBENCH_STATIC_BRANCHES;
+    s.branches[i].PC = StaticPC(b);
+    s.branches[i].taken = (++count[b] % period[b]) != 0;
+  }
+  return s;
+}
+
+// Random branches with random outcomes: every lookup misses somewhere
+static BENCH_STREAM RandomStream(UINT32 n) {
+  BENCH_STREAM s = {"random", std::vector<BENCH_BRANCH>(n)};
+  UINT32 seed = 23456;
+
+  for (UINT32 i = 0; i < n; i++) {
+    UINT32 r = NextSeed(&seed);
+    s.branches[i].PC = StaticPC(r % MICROBENCH_STATIC_BRANCHES);
+    s.branches[i].taken = (r >> 12) & 1;
+  }
+  return s;
+}
+
+// Outcomes are the XOR of two earlier global outcomes, at distances
+// that differ per branch, so only history-indexed tables predict them
+static BENCH_STREAM CorrelatedStream(UINT32 n) {
+  BENCH_STREAM s = {"correlated", std::vector<BENCH_BRANCH>(n)};
+  UINT64 history = 0x5555;
+  UINT32 seed = 34567;
+  UINT32 b = 0;
+
+  for (UINT32 i = 0; i < n; i++) {
+    UINT32 r = NextSeed(&seed);
+    b = (r % 16 == 0) ? (r >> 4) % 256 : (b + 1) % 256;
+    bool taken = ((history >> (b % 13)) ^ (history >> (b % 29 + 13))) & 1;
+    if (r % 64 == 1) {
+      taken = !taken; // a little noise
+    }
+    s.branches[i].PC = StaticPC(b);
+    s.branches[i].taken = taken;
+    history = (history << 1) | taken;
+  }
+  return s;
+}
+
+static BENCH_STREAM TraceStream(const char *fileName, UINT32 n) {
+  BENCH_STREAM s = {std::string("trace:") + fileName, {}};
+  // keep a synth: spec one CSV field
+  std::replace(s.name.begin(), s.name.end(), ',', ';');
+  CBP_TRACER tracer((char *)fileName);
+  CBP_TRACE_RECORD rec;
+
+  tracer.SetHeartBeat(false);
+  while (s.branches.size() < n && tracer.GetNextRecord(&rec)) {
+    if (rec.opType == OPTYPE_BRANCH_COND) {
+      s.branches.push_back({rec.PC, rec.branchTaken});
+    }
+  }
+  return s;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+typedef std::chrono::steady_clock::time_point BENCH_TIME;
+
+static UINT32 HistoryWidth(const PREDICTOR_CONFIG &config) {
+  UINT32 width = 0;
+  for (UINT32 w : config.tage_history_width) {
+    width = std::max(width, w);
+  }
+  return width;
+}
+
+static double NsPerBranch(BENCH_TIME start, size_t n) {
+  std::chrono::duration<double, std::nano> d =
+      std::chrono::steady_clock::now() - start;
+  return d.count() / n;
+}
+
+// Each benchmark builds its component cold, then times one pass over
+// the stream. sink keeps the results live.
+typedef double (*BENCH_FN)(const PREDICTOR_CONFIG &config,
+                           const std::vector<BENCH_BRANCH> &stream,
+                           UINT32 *sink);
+
+static double BenchBase(const PREDICTOR_CONFIG &config,
+                        const std::vector<BENCH_BRANCH> &stream,
+                        UINT32 *sink) {
+  DYNAMIC_GEOMETRY geom(config);
+  BasePredictor<DYNAMIC_GEOMETRY> bp(geom);
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    *sink += bp.predict(br.PC);
+    bp.update(br.taken);
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+// TAGE lookups only, over a fixed history
+static double BenchTageMatch(const PREDICTOR_CONFIG &config,
+                             const std::vector<BENCH_BRANCH> &stream,
+                             UINT32 *sink) {
+  DYNAMIC_GEOMETRY geom(config);
+  GlobalHistory ghr;
+  ghr.init(HistoryWidth(config));
+  PathHistory path;
+  path.init(config.path_history_width);
+  TAGE<DYNAMIC_GEOMETRY> tage(geom, config, &ghr, &path);
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    *sink += tage.match(br.PC);
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+// TAGE lookups, allocation on a miss and the history update
+static double BenchTageUpdate(const PREDICTOR_CONFIG &config,
+                              const std::vector<BENCH_BRANCH> &stream,
+                              UINT32 *sink) {
+  DYNAMIC_GEOMETRY geom(config);
+  GlobalHistory ghr;
+  ghr.init(HistoryWidth(config));
+  PathHistory path;
+  path.init(config.path_history_width);
+  TAGE<DYNAMIC_GEOMETRY> tage(geom, config, &ghr, &path);
+  UINT32 tables = geom.tageTableNum();
+  UINT32 i = 0;
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    UINT32 hits = tage.match(br.PC);
+    *sink += hits;
+    if (hits == 0) {
+      tage.updateMissNewEntry(i++ % tables, br.taken);
+    }
+    tage.updateHistory(br.taken);
+    ghr.push(br.taken);
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+static double BenchLoop(const PREDICTOR_CONFIG &config,
+                        const std::vector<BENCH_BRANCH> &stream,
+                        UINT32 *sink) {
+  DYNAMIC_GEOMETRY geom(config);
+  LoopPredictor<DYNAMIC_GEOMETRY> lp(geom);
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    lp.predict(br.PC);
+    *sink += lp.useLoop() + lp.prediction();
+    // stand-in for the TAGE prediction: the opposite of the outcome,
+    // so the loop entries keep allocating and training
+    lp.update(br.taken, !br.taken);
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+static double BenchCf(const PREDICTOR_CONFIG &config,
+                      const std::vector<BENCH_BRANCH> &stream,
+                      UINT32 *sink) {
+  DYNAMIC_GEOMETRY geom(config);
+  CorrectorFilter<DYNAMIC_GEOMETRY> cf(geom, config.cf_ctr_strong,
+                                       config.cf_ctr_weak);
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    // a low-confidence TAGE guess from the PC, so every branch reaches
+    // the filter
+    bool tage_result = (br.PC >> 4) & 1;
+    *sink += cf.predict(br.PC, tage_result, false);
+    cf.update(tage_result, br.taken, false);
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+static double BenchSc(const PREDICTOR_CONFIG &config,
+                      const std::vector<BENCH_BRANCH> &stream,
+                      UINT32 *sink) {
+  PREDICTOR_CONFIG sc_config = config;
+  sc_config.sc = true;
+  GlobalHistory ghr;
+  ghr.init(*std::max_element(sc_config.sc_global_history_width.begin(),
+                             sc_config.sc_global_history_width.end()));
+  StatisticalCorrector corrector(sc_config, &ghr);
+  LocalHistoryTable lht(sc_config, true);
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    // TAGE stand-in as for the filter: a guess from the PC
+    UINT32 local = lht.lookup(br.PC);
+    INT32 sum = corrector.predict(br.PC, (br.PC >> 4) & 1, false, local);
+    *sink += (sum >= 0);
+    corrector.update(br.PC, br.taken, br.PC - 64);
+    corrector.updateHistory(br.taken);
+    lht.update(br.taken, 0);
+    ghr.push(br.taken);
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+// The local history table and the local component
+static double BenchLocal(const PREDICTOR_CONFIG &config,
+                         const std::vector<BENCH_BRANCH> &stream,
+                         UINT32 *sink) {
+  PREDICTOR_CONFIG local_config = config;
+  local_config.local = true;
+  LocalHistoryTable lht(local_config, true);
+  LocalPredictor local(local_config);
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    *sink += local.predict(br.PC, lht.lookup(br.PC)) + local.highConf();
+    local.update(br.taken);
+    lht.update(br.taken, lht.chooser());
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+static double BenchPredictor(const PREDICTOR_CONFIG &config,
+                             const std::vector<BENCH_BRANCH> &stream,
+                             UINT32 *sink) {
+  TAGE_SC_L<DYNAMIC_GEOMETRY> pred(config);
+
+  BENCH_TIME start = std::chrono::steady_clock::now();
+  for (const BENCH_BRANCH &br : stream) {
+    bool predDir = pred.GetPrediction(br.PC);
+    *sink += (predDir != br.taken);
+    pred.UpdatePredictor(br.PC, br.taken, predDir, 0);
+  }
+  return NsPerBranch(start, stream.size());
+}
+
+static const struct {
+  const char *name;
+  BENCH_FN fn;
+} benchmarks[] = {
+    {"base.predict_update", BenchBase},
+    {"tage.match", BenchTageMatch},
+    {"tage.match_update", BenchTageUpdate},
+    {"loop.predict_update", BenchLoop},
+    {"cf.predict_update", BenchCf},
+    {"sc.predict_update", BenchSc},
+    {"local.predict_update", BenchLocal},
+    {"predictor", BenchPredictor},
+};
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// "benchmark,stream,config" -> ns_per_op from an earlier -o CSV
+static std::map<std::string, double> LoadBaseline(const char *fileName) {
+  std::ifstream in(fileName);
+  if (!in) {
+    printf("Unable to open %s. Dying\n", fileName);
+    exit(-1);
+  }
+
+  std::map<std::string, double> base;
+  std::string line;
+  while (std::getline(in, line)) {
+    // benchmark,stream,ns_per_op,config; the config may hold commas
+    size_t c1 = line.find(',');
+    size_t c2 = line.find(',', c1 + 1);
+    size_t c3 = line.find(',', c2 + 1);
+    if (c1 == std::string::npos || c2 == std::string::npos ||
+        c3 == std::string::npos || line.compare(0, c1, "benchmark") == 0) {
+      continue;
+    }
+    base[line.substr(0, c2) + line.substr(c3)] =
+        atof(line.substr(c2 + 1, c3 - c2 - 1).c_str());
+  }
+  return base;
+}
+
+int main(int argc, char* argv[]){
+
+  UINT32 n = MICROBENCH_BRANCHES;
+  UINT32 runs = MICROBENCH_RUNS;
+  std::vector<std::string> specs;
+  std::vector<const char *> traces;
+  const char *filter = "";
+  const char *outName = NULL;
+  const char *compareName = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "-n") && hasValue) {
+      n = strtoul(argv[++i], NULL, 0);
+    }
+    else if (!strcmp(argv[i], "-r") && hasValue) {
+      runs = std::max(1ul, strtoul(argv[++i], NULL, 0));
+    }
+    else if (!strcmp(argv[i], "-s") && hasValue) {
+      specs.push_back(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "-t") && hasValue) {
+      traces.push_back(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "-f") && hasValue) {
+      filter = argv[++i];
+    }
+    else if (!strcmp(argv[i], "-o") && hasValue) {
+      outName = argv[++i];
+    }
+    else if (!strcmp(argv[i], "-compare") && hasValue) {
+      compareName = argv[++i];
+    }
+    else {
+      printf("usage: %s [-n <branches>] [-r <runs>] [-s <spec>]... "
+             "[-t <trace>]... [-f <filter>] [-o <csv>] [-compare <csv>]\n",
+             argv[0]);
+      exit(-1);
+    }
+  }
+
+  if (specs.empty()) {
+    specs.push_back("default");
+  }
+
+  std::vector<PREDICTOR_CONFIG> configs(specs.size());
+  for (UINT32 c = 0; c < specs.size(); c++) {
+    if (specs[c] != "default" && !configs[c].parse(specs[c].c_str())) {
+      exit(-1);
+    }
+  }
+
+  std::vector<BENCH_STREAM> streams;
+  streams.push_back(LoopStream(n));
+  streams.push_back(RandomStream(n));
+  streams.push_back(CorrelatedStream(n));
+  for (const char *trace : traces) {
+    streams.push_back(TraceStream(trace, n));
+  }
+
+  std::map<std::string, double> base;
+  if (compareName) {
+    base = LoadBaseline(compareName);
+  }
+
+  FILE *out = NULL;
+  if (outName && (out = fopen(outName, "w")) == NULL) {
+    printf("Unable to open %s. Dying\n", outName);
+    exit(-1);
+  }
+
+  const char *header = compareName
+      ? "benchmark,stream,ns_per_op,base_ns_per_op,change_pct,config\n"
+      : "benchmark,stream,ns_per_op,config\n";
+  printf("%s", header);
+  if (out) {
+    fprintf(out, "benchmark,stream,ns_per_op,config\n");
+  }
+
+  UINT32 sink = 0;
+  for (const auto &bench : benchmarks) {
+    if (!strstr(bench.name, filter)) {
+      continue;
+    }
+    for (const BENCH_STREAM &stream : streams) {
+      if (stream.branches.empty()) {
+        continue;
+      }
+      for (UINT32 c = 0; c < configs.size(); c++) {
+        double best = 1e30;
+        for (UINT32 r = 0; r < runs; r++) {
+          best = std::min(best, bench.fn(configs[c], stream.branches, &sink));
+        }
+
+        std::string key = std::string(bench.name) + "," + stream.name + "," +
+                          specs[c];
+        auto b = base.find(key);
+        if (compareName && b != base.end() && b->second > 0) {
+          printf("%s,%s,%.2f,%.2f,%+.1f,%s\n", bench.name,
+                 stream.name.c_str(), best, b->second,
+                 100.0 * (best - b->second) / b->second, specs[c].c_str());
+        }
+        else if (compareName) {
+          printf("%s,%s,%.2f,,,%s\n", bench.name, stream.name.c_str(), best,
+                 specs[c].c_str());
+        }
+        else {
+          printf("%s,%s,%.2f,%s\n", bench.name, stream.name.c_str(), best,
+                 specs[c].c_str());
+        }
+        if (out) {
+          fprintf(out, "%s,%s,%.2f,%s\n", bench.name, stream.name.c_str(),
+                  best, specs[c].c_str());
+        }
+        fflush(stdout);
+      }
+    }
+  }
+
+  if (out) {
+    fclose(out);
+  }
+
+  // keep the results live
+  return sink == 0xFFFFFFFF;
+}
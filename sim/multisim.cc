@@ -0,0 +1,94 @@
+// multisim: evaluate several PREDICTOR configurations over one pass of a
+// trace. Records are decoded once into a block, and each predictor then
+// replays the whole block while it is still hot in cache.
+
+#include <cstring>
+#include <vector>
+#include "utils.h"
+#include "tracer.h"
+#include "predictor.h"
+
+
+// usage: multisim <trace> <config> [<config> ...]
+//   config: "default", key=value[,key=value...] or a config file name,
+//           see PREDICTOR_CONFIG
+//   e.g.    multisim trace.cbp4.gz default tage_tag_width=11 big.cfg
+
+#define MULTISIM_BLOCK_SIZE 4096
+
+int main(int argc, char* argv[]){
+
+  if (argc < 3) {
+    printf("usage: %s <trace> <config> [<config> ...]\n", argv[0]);
+    exit(-1);
+  }
+
+  UINT32 numPred = argc - 2;
+  std::vector<std::unique_ptr<PREDICTOR>> brpred;
+  std::vector<UINT64> numMispred(numPred, 0);
+  bool needsOtherInst = false;
+
+  for (UINT32 p = 0; p < numPred; p++) {
+    PREDICTOR_CONFIG config;
+    const char *spec = argv[p + 2];
+    if (strcmp(spec, "default") == 0) {
+      // PREDICTOR_CONFIG defaults
+    }
+    else if (strchr(spec, '=') ? !config.parse(spec) : !config.load(spec)) {
+      exit(-1);
+    }
+    brpred.push_back(std::make_unique<PREDICTOR>(config));
+    needsOtherInst |= config.needsOtherInst();
+  }
+
+  CBP_TRACER *tracer = new CBP_TRACER(argv[1]);
+  if (tracer->IsCondOnly() && needsOtherInst) {
+    printf("Path history needs the non-conditional branches, which a filtered replay drops. Dying\n");
+    exit(-1);
+  }
+  std::vector<CBP_TRACE_RECORD> block(MULTISIM_BLOCK_SIZE);
+  UINT32 blockSize;
+
+  do {
+    for (blockSize = 0; blockSize < MULTISIM_BLOCK_SIZE; blockSize++) {
+      if (!tracer->GetNextRecord(&block[blockSize])) {
+        break;
+      }
+    }
+
+    for (UINT32 p = 0; p < numPred; p++) {
+      PREDICTOR *pred = brpred[p].get();
+
+      for (UINT32 i = 0; i < blockSize; i++) {
+        const CBP_TRACE_RECORD &trace = block[i];
+
+        if (trace.opType == OPTYPE_BRANCH_COND) {
+          bool predDir = pred->GetPrediction(trace.PC);
+          pred->UpdatePredictor(trace.PC, trace.branchTaken, predDir,
+                                trace.branchTarget);
+          if (predDir != trace.branchTaken) {
+            numMispred[p]++;
+          }
+        }
+        else {
+          pred->TrackOtherInst(trace.PC, trace.opType, trace.branchTarget);
+        }
+      }
+    }
+  } while (blockSize == MULTISIM_BLOCK_SIZE);
+
+  printf("\n");
+  printf("\nNUM_INSTRUCTIONS     \t : %10llu",   tracer->GetNumInst());
+  printf("\nNUM_CONDITIONAL_BR   \t : %10llu",   tracer->GetNumCondBranch());
+  for (UINT32 p = 0; p < numPred; p++) {
+    printf("\n");
+    printf("\nCONFIG_%-14u\t : %s",             p, argv[p + 2]);
+    printf("\nNUM_MISPREDICTIONS_%-2u\t : %10llu", p, numMispred[p]);
+    printf("\nMISPRED_PER_1K_INST_%u\t : %10.3f", p,
+           1000.0*(double)(numMispred[p])/(double)(tracer->GetNumInst()));
+    printf("\nSTORAGE_BITS_%-8u\t : %10llu", p, brpred[p]->GetStorageBits());
+  }
+  printf("\n\n");
+
+  delete tracer;
+}
@@ -1,16 +1,38 @@
 #include "predictor.h"
 #include "utils.h"
 #include <algorithm>
+#include <cmath>
 #include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TAGE_MATCH_X86
+#endif
+
+// DYNAMIC_GEOMETRY
+
+DYNAMIC_GEOMETRY::DYNAMIC_GEOMETRY(const PREDICTOR_CONFIG &config) {
+  base_table_entry_num = config.base_table_entry_num;
+  tage_table_num = config.tage_history_width.size();
+  tage_index_width = config.tage_index_width;
+  tage_tag_width = config.tage_tag_width;
+  loop_index_width = config.loop_index_width;
+  loop_tag_width = config.loop_tag_width;
+  cf_ctr_num = config.cf_ctr_num;
+  cf_tag_width = config.cf_tag_width;
+}
 
-BasePredictor::BasePredictor() {
+// BasePredictor
+
+template <class G>
+BasePredictor<G>::BasePredictor(const G &geometry) : geom(geometry) {
   // Set all entries to the initial counter value
-  std::memset(base_table, BASE_CTR_INIT, sizeof(base_table));
+  base_table.assign(geom.baseTableEntryNum(), BASE_CTR_INIT);
 }
 
-bool BasePredictor::predict(UINT32 PC) {
+template <class G>
+bool BasePredictor<G>::predict(UINT32 PC) {
   // Calculate the index for the base predictor table
-  base_table_index = PC % BASE_TABLE_ENTRY_NUM;
+  base_table_index = PC % geom.baseTableEntryNum();
 
   // Retrieve the counter value from the table
   base_counter = base_table[base_table_index];
@@ -22,23 +44,226 @@ bool BasePredictor::predict(UINT32 PC) {
   return base_counter > BASE_CTR_MAX / 2;
 }
 
-void BasePredictor::update(bool resolveDir) {
+template <class G>
+void BasePredictor<G>::update(bool resolveDir) {
   // Update the counter value based on the actual outcome (resolveDir)
   base_table[base_table_index] = (resolveDir == TAKEN)
                                      ? SatIncrement(base_counter, BASE_CTR_MAX)
                                      : SatDecrement(base_counter);
 }
 
-bool BasePredictor::highConf() {
+template <class G>
+bool BasePredictor<G>::highConf() {
   // Return the high confidence status
   return high_conf;
 }
 
-TAGE::TAGE(UINT32 history_width, UINT128 *ghr) {
+template <class G>
+void BasePredictor<G>::checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  cp.array(base_table.data(), base_table.size());
+}
+
+template <class G>
+UINT64 BasePredictor<G>::storageBits() {
+  // 2-bit counters
+  return (UINT64)geom.baseTableEntryNum() * 2;
+}
+
+// TAGE tag match
+
+static_assert(sizeof(TageEntry) == 4 && offsetof(TageEntry, tag) == 0,
+              "SIMD tag match expects the tag in the low half of an entry");
+
+static inline UINT32 lowMask(UINT32 n) {
+  return (n >= 32) ? ~0u : (1u << n) - 1;
+}
+
+static UINT32 tageMatchScalar(const TageEntry *arena, const UINT32 *index,
+                              const UINT32 *tag, UINT32 n) {
+  UINT32 hits = 0;
+  for (UINT32 t = 0; t < n; t++) {
+    hits |= (UINT32)(arena[index[t]].tag == tag[t]) << t;
+  }
+  return hits;
+}
+
+#ifdef TAGE_MATCH_X86
+static inline int loadEntry(const TageEntry *arena, UINT32 i) {
+  int e;
+  memcpy(&e, &arena[i], sizeof(e));
+  return e;
+}
+
+static UINT32 tageMatchSSE2(const TageEntry *arena, const UINT32 *index,
+                            const UINT32 *tag, UINT32 n) {
+  const __m128i low = _mm_set1_epi32(0xFFFF);
+  UINT32 hits = 0;
+  for (UINT32 t = 0; t < n; t += 4) {
+    __m128i e = _mm_set_epi32(
+        loadEntry(arena, index[t + 3]), loadEntry(arena, index[t + 2]),
+        loadEntry(arena, index[t + 1]), loadEntry(arena, index[t]));
+    __m128i tg = _mm_loadu_si128((const __m128i *)(tag + t));
+    __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(e, low), tg);
+    hits |= (UINT32)_mm_movemask_ps(_mm_castsi128_ps(eq)) << t;
+  }
+  return hits & lowMask(n);
+}
+
+__attribute__((target("avx2")))
+static UINT32 tageMatchAVX2(const TageEntry *arena, const UINT32 *index,
+                            const UINT32 *tag, UINT32 n) {
+  const __m256i low = _mm256_set1_epi32(0xFFFF);
+  UINT32 hits = 0;
+  for (UINT32 t = 0; t < n; t += 8) {
+    __m256i idx = _mm256_loadu_si256((const __m256i *)(index + t));
+    __m256i e = _mm256_i32gather_epi32((const int *)arena, idx, 4);
+    __m256i tg = _mm256_loadu_si256((const __m256i *)(tag + t));
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(e, low), tg);
+    hits |= (UINT32)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) << t;
+  }
+  return hits & lowMask(n);
+}
+#endif
+
+// Set-associative lookups, one set per table
+
+static UINT32 tageMatchSetsScalar(const TageEntry *arena, UINT32 *index,
+                                  const UINT32 *tag, UINT32 n, UINT32 ways) {
+  UINT32 hits = 0;
+  for (UINT32 t = 0; t < n; t++) {
+    const TageEntry *set = arena + index[t];
+    UINT32 hit = ways;
+    UINT32 victim = 0;
+    for (UINT32 w = 0; w < ways; w++) {
+      if (set[w].tag == tag[t] && hit == ways) {
+        hit = w;
+      }
+      if (set[w].u < set[victim].u) {
+        victim = w;
+      }
+    }
+    hits |= (UINT32)(hit != ways) << t;
+    index[t] += (hit != ways) ? hit : victim;
+  }
+  return hits;
+}
+
+#ifdef TAGE_MATCH_X86
+// A whole set per compare. The victim is the minimum of (u << 2) | way
+// over the set, found with two shuffles; ways past the set get a key
+// that never wins.
+template <UINT32 Ways>
+static UINT32 tageMatchSetsSSE2(const TageEntry *arena, UINT32 *index,
+                                const UINT32 *tag, UINT32 n) {
+  const __m128i low = _mm_set1_epi32(0xFFFF);
+  const __m128i way = _mm_set_epi32(3, 2, 1, 0);
+  const __m128i unused = (Ways == 4) ? _mm_setzero_si128()
+                                     : _mm_set_epi32(0x7FFF, 0x7FFF, 0, 0);
+  const UINT32 way_mask = (1u << Ways) - 1;
+  UINT32 hits = 0;
+  for (UINT32 t = 0; t < n; t++) {
+    const TageEntry *set = arena + index[t];
+    __m128i e = (Ways == 4) ? _mm_load_si128((const __m128i *)set)
+                            : _mm_loadl_epi64((const __m128i *)set);
+    __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(e, low),
+                                 _mm_set1_epi32(tag[t]));
+    UINT32 hit = _mm_movemask_ps(_mm_castsi128_ps(eq)) & way_mask;
+
+    // u is the top byte of an entry
+    __m128i key = _mm_slli_epi32(_mm_srli_epi32(e, 24), 2);
+    key = _mm_or_si128(_mm_or_si128(key, way), unused);
+    key = _mm_min_epi16(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(1, 0, 3, 2)));
+    key = _mm_min_epi16(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(2, 3, 0, 1)));
+    UINT32 victim = _mm_cvtsi128_si32(key) & 3;
+
+    hits |= (UINT32)(hit != 0) << t;
+    index[t] += hit ? __builtin_ctz(hit) : victim;
+  }
+  return hits;
+}
+
+static UINT32 tageMatchSetsSSE2(const TageEntry *arena, UINT32 *index,
+                                const UINT32 *tag, UINT32 n, UINT32 ways) {
+  return (ways == 4) ? tageMatchSetsSSE2<4>(arena, index, tag, n)
+                     : tageMatchSetsSSE2<2>(arena, index, tag, n);
+}
+#endif
+
+static TageSetMatchFn tageSelectSetMatch(UINT32 mode) {
+#ifdef TAGE_MATCH_X86
+  // AVX2 has nothing to add when a set is one 16-byte load
+  if (mode != TAGE_MATCH_SCALAR) {
+    return tageMatchSetsSSE2;
+  }
+#endif
+  return tageMatchSetsScalar;
+}
+
+static TageMatchFn tageSelectMatch(UINT32 mode) {
+#ifdef TAGE_MATCH_X86
+  // SSE2 is always there on x86-64 and its four scalar loads measure as
+  // fast as the AVX2 gather, so auto does not need the CPUID check
+  if (mode == TAGE_MATCH_AUTO || mode == TAGE_MATCH_SSE2) {
+    return tageMatchSSE2;
+  }
+  if (mode == TAGE_MATCH_AVX2) {
+    if (!__builtin_cpu_supports("avx2")) {
+      printf("tage_match=avx2: this CPU does not support AVX2\n");
+      exit(-1);
+    }
+    return tageMatchAVX2;
+  }
+#else
+  if (mode == TAGE_MATCH_SSE2 || mode == TAGE_MATCH_AVX2) {
+    printf("tage_match: SIMD matchers are only built for x86\n");
+    exit(-1);
+  }
+#endif
+  return tageMatchScalar;
+}
+
+// TAGE
+
+template <class G>
+TAGE<G>::TAGE(const G &geometry, const PREDICTOR_CONFIG &config,
+              const GlobalHistory *ghr, const PathHistory *path)
+    : geom(geometry) {
+  const std::vector<UINT32> &history_width = config.tage_history_width;
   this->ghr = ghr;
-  tag_history_width = history_width;
-  tag_table_entry_num = 1 << TAGE_TABLE_INDEX_WIDTH;
-  tag_table = new TageEntry[tag_table_entry_num];
+  this->path = path;
+  path_width = config.path_history_width;
+  this->tag_hash = config.tage_tag_hash;
+  match_tags = tageSelectMatch(config.tage_match);
+  match_sets = tageSelectSetMatch(config.tage_match);
+  ways = config.tage_ways;
+  way_shift = __builtin_ctz(ways);
+  banked = config.tage_banked;
+  if (way_shift >= geom.tageIndexWidth()) {
+    printf("tage_ways=%u needs a tage_index_width above %u. Dying\n", ways,
+           way_shift);
+    exit(-1);
+  }
+  tag_table_entry_num = geom.tageTableNum() << geom.tageIndexWidth();
+  // aligned_alloc wants a multiple of the alignment
+  size_t bytes = (tag_table_entry_num * sizeof(TageEntry) + 63) & ~(size_t)63;
+  tag_table = (TageEntry *)aligned_alloc(64, bytes);
+  if (tag_table == NULL) {
+    printf("Unable to allocate %zu bytes of TAGE tables. Dying\n", bytes);
+    exit(-1);
+  }
+
+  for (UINT32 t = 0; t < geom.tageTableNum(); t++) {
+    tag_history_width[t] = history_width[t];
+    index_fold[t].init(history_width[t], geom.tageIndexWidth() - way_shift);
+    tag_fold[t][0].init(history_width[t], geom.tageTagWidth());
+    tag_fold[t][1].init(history_width[t],
+                        std::max(geom.tageTagWidth() - 1, 1u));
+    path_mask[t] = lowMask(std::min(path_width, history_width[t]));
+  }
+
+  // Unused slots point at entry 0 so the SIMD matchers can read them
+  memset(index, 0, sizeof(index));
+  memset(tag, 0, sizeof(tag));
 
   // Initialize the TAGE table entries
   for (UINT32 i = 0; i < tag_table_entry_num; i++) {
@@ -48,91 +273,186 @@ TAGE::TAGE(UINT32 history_width, UINT128 *ghr) {
   }
 }
 
-UINT16 TAGE::getTag(UINT32 PC) {
-  // Calculate the tag using the global history register and the PC
-  UINT128 temp_ghr = *ghr;
-  temp_ghr = lowbits(temp_ghr, TAGE_TAG_WIDTH);
-  return lowbits((temp_ghr + PC * LARGE_PRIME), TAGE_TAG_WIDTH);
+template <class G>
+TAGE<G>::~TAGE() { free(tag_table); }
+
+// The table's share of the path history, spread over width bits by a
+// multiplicative hash; a different multiplier for the index and the tag
+// keeps them from aliasing together
+static inline UINT32 pathHash(UINT32 path, UINT32 multiplier, UINT32 width) {
+  return (path * multiplier) >> (32 - width);
+}
+
+template <class G>
+UINT16 TAGE<G>::getTag(UINT32 PC, UINT32 t) {
+  UINT32 hashed;
+  if (tag_hash == TAGE_TAG_HASH_FOLDED) {
+    // Whole table history, as in the TAGE papers
+    hashed = lowbits((PC ^ tag_fold[t][0].comp ^ (tag_fold[t][1].comp << 1)),
+                     geom.tageTagWidth());
+  } else {
+    // Calculate the tag using the global history register and the PC
+    UINT32 temp_ghr = lowbits((UINT32)ghr->recent(), geom.tageTagWidth());
+    hashed = lowbits((temp_ghr + PC * LARGE_PRIME), geom.tageTagWidth());
+  }
+
+  if (path_width) {
+    hashed ^= pathHash(path->value() & path_mask[t], 0x85EBCA6Bu,
+                       geom.tageTagWidth());
+  }
+  return hashed;
 }
 
-UINT32 TAGE::getTagTableIndex(UINT32 PC) {
-  // Calculate the index for the tag table using the PC and global history
-  // register
-  UINT128 temp_ghr = *ghr;
-  int history_width = tag_history_width;
-  UINT32 temp_pc = lowbits(PC, TAGE_TABLE_INDEX_WIDTH);
+template <class G>
+UINT32 TAGE<G>::getTagTableIndex(UINT32 PC, UINT32 t) {
+  // PC XOR the table history folded onto the set index width;
+  // index_fold holds the XOR of every such block of the history
+  UINT32 set_width = geom.tageIndexWidth() - way_shift;
+  UINT32 hashed = lowbits(PC, set_width) ^ index_fold[t].comp;
 
-  // Fold the global history register into the index
-  while (history_width > 0) {
-    int block_width = std::min(history_width, TAGE_TABLE_INDEX_WIDTH);
-    temp_pc ^= lowbits(temp_ghr, block_width);
-    temp_ghr = temp_ghr >> block_width;
-    history_width -= block_width;
+  if (path_width) {
+    hashed ^= pathHash(path->value() & path_mask[t], 0x9E3779B1u, set_width);
   }
+  return hashed;
+}
 
-  return lowbits(temp_pc, TAGE_TABLE_INDEX_WIDTH);
+template <class G>
+void TAGE<G>::updateHistory(bool resolveDir) {
+  for (UINT32 t = 0; t < geom.tageTableNum(); t++) {
+    // Bit leaving this table's history window
+    bool oldest = ghr->bit(tag_history_width[t] - 1);
+    index_fold[t].update(resolveDir, oldest);
+    tag_fold[t][0].update(resolveDir, oldest);
+    tag_fold[t][1].update(resolveDir, oldest);
+  }
 }
 
-bool TAGE::match(UINT32 PC) {
-  // Check if the tag matches the entry in the tag table
-  tag = getTag(PC);
-  index = getTagTableIndex(PC);
-  return tag_table[index].tag == tag;
+template <class G>
+UINT32 TAGE<G>::match(UINT32 PC) {
+  if (ways == 1 && !banked) {
+    // Hash every table first ...
+    for (UINT32 t = 0; t < geom.tageTableNum(); t++) {
+      index[t] = (t << geom.tageIndexWidth()) | getTagTableIndex(PC, t);
+      tag[t] = getTag(PC, t);
+    }
+
+    // ... then check the tags, the loads are independent of each other
+    return match_tags(tag_table, index, tag, geom.tageTableNum());
+  }
+
+  // Banked: consecutive tables in consecutive banks from a start that
+  // depends on the PC, scaled onto [0, tables) without a division
+  UINT32 tables = geom.tageTableNum();
+  UINT32 start = 0;
+  if (banked) {
+    start = ((UINT64)((PC ^ (PC >> 2) ^ (PC >> 6)) * 0x9E3779B1u) * tables) >> 32;
+  }
+  for (UINT32 t = 0; t < tables; t++) {
+    UINT32 slice = start + t;
+    slice -= (slice >= tables) ? tables : 0;
+    index[t] = (slice << geom.tageIndexWidth()) |
+               (getTagTableIndex(PC, t) << way_shift);
+    tag[t] = getTag(PC, t);
+  }
+  if (ways > 1) {
+    return match_sets(tag_table, index, tag, geom.tageTableNum(), ways);
+  }
+  return match_tags(tag_table, index, tag, geom.tageTableNum());
 }
 
-bool TAGE::predict() {
+template <class G>
+bool TAGE<G>::predict(UINT32 t) {
   // Predict the outcome based on the counter value
-  return tag_table[index].pred > TAGE_CTR_MAX / 2;
+  return tag_table[index[t]].pred > TAGE_CTR_MAX / 2;
 }
 
-bool TAGE::highConf() {
+template <class G>
+bool TAGE<G>::highConf(UINT32 t) {
   // Determine if the prediction is high confidence
-  return tag_table[index].pred <= TAGE_CTR_WEAK ||
-         tag_table[index].pred >= TAGE_CTR_STRONG;
+  return tag_table[index[t]].pred <= TAGE_CTR_WEAK ||
+         tag_table[index[t]].pred >= TAGE_CTR_STRONG;
 }
 
-void TAGE::updateHit(bool resolveDir) {
+template <class G>
+void TAGE<G>::updateHit(UINT32 t, bool resolveDir) {
   // Update the counter based on the actual outcome
-  tag_table[index].pred =
-      (resolveDir == TAKEN) ? SatIncrement(tag_table[index].pred, TAGE_CTR_MAX)
-                            : SatDecrement(tag_table[index].pred);
+  TageEntry &entry = tag_table[index[t]];
+  entry.pred = (resolveDir == TAKEN) ? SatIncrement(entry.pred, TAGE_CTR_MAX)
+                                     : SatDecrement(entry.pred);
 }
 
-void TAGE::updateMiss() {
+template <class G>
+void TAGE<G>::updateMiss(UINT32 t) {
   // Decrement the usefulness counter on a miss
-  tag_table[index].u = SatDecrement(tag_table[index].u);
+  tag_table[index[t]].u = SatDecrement(tag_table[index[t]].u);
 }
 
-void TAGE::updateMissNewEntry(bool resolveDir) {
+template <class G>
+void TAGE<G>::updateMissNewEntry(UINT32 t, bool resolveDir) {
   // Allocate a new entry on a miss
-  tag_table[index].tag = tag;
-  tag_table[index].u = 0;
-  tag_table[index].pred =
-      resolveDir ? TAGE_WEAK_CORRECT : TAGE_WEAK_CORRECT - 1;
+  TageEntry &entry = tag_table[index[t]];
+  entry.tag = tag[t];
+  entry.u = 0;
+  entry.pred = resolveDir ? TAGE_WEAK_CORRECT : TAGE_WEAK_CORRECT - 1;
 }
 
-void TAGE::updateU(bool resolveDir, bool predDir) {
+template <class G>
+void TAGE<G>::updateU(UINT32 t, bool resolveDir, bool predDir) {
   // Update the usefulness counter based on the prediction accuracy
-  UINT8 u = tag_table[index].u;
-  tag_table[index].u =
+  UINT8 u = tag_table[index[t]].u;
+  tag_table[index[t]].u =
       (resolveDir == predDir) ? SatIncrement(u, TAGE_U_MAX) : SatDecrement(u);
 }
 
-void TAGE::resetU(UINT8 mask) {
-  // Periodically reset the usefulness counters
-  for (UINT32 i = 0; i < tag_table_entry_num; i++) {
+template <class G>
+void TAGE<G>::resetU(UINT8 mask, UINT32 from, UINT32 to) {
+  // Periodically reset the usefulness counters of a range of entries
+  for (UINT32 i = from; i < to; i++) {
     tag_table[i].u = tag_table[i].u & mask;
   }
 }
 
-UINT8 TAGE::getU() {
+template <class G>
+UINT32 TAGE<G>::uZeroMask() {
+  // Bit t set if the entry of table t has a zero usefulness counter
+  UINT32 mask = 0;
+  for (UINT32 t = 0; t < geom.tageTableNum(); t++) {
+    mask |= (UINT32)(tag_table[index[t]].u == 0) << t;
+  }
+  return mask;
+}
+
+template <class G>
+UINT8 TAGE<G>::getU(UINT32 t) {
   // Get the usefulness counter value
-  return tag_table[index].u;
+  return tag_table[index[t]].u;
+}
+
+template <class G>
+UINT64 TAGE<G>::storageBits() {
+  // tag + 3-bit prediction counter + 2-bit usefulness counter per entry
+  return (UINT64)tag_table_entry_num * (geom.tageTagWidth() + 3 + 2);
+}
+
+template <class G>
+void TAGE<G>::checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  cp.check(tag_hash, "tage_tag_hash");
+  cp.check(ways, "tage_ways");
+  cp.check(banked, "tage_banked");
+  for (UINT32 t = 0; t < geom.tageTableNum(); t++) {
+    cp.check(tag_history_width[t], "tage_history_width");
+    cp.value(index_fold[t].comp);
+    cp.value(tag_fold[t][0].comp);
+    cp.value(tag_fold[t][1].comp);
+  }
+  cp.array(tag_table, tag_table_entry_num);
 }
 
 // LoopPredictor
-LoopPredictor::LoopPredictor() {
-  for (UINT32 i = 0; i < LOOP_TABLE_ENTRY_NUM; i++) {
+template <class G>
+LoopPredictor<G>::LoopPredictor(const G &geometry) : geom(geometry) {
+  table.resize(1 << geom.loopIndexWidth());
+  for (UINT32 i = 0; i < table.size(); i++) {
     resetEntry(i);
   }
   use_loop = false;
@@ -140,13 +460,14 @@ LoopPredictor::LoopPredictor() {
   index = 0;
   tag = 0;
 }
-void LoopPredictor::predict(UINT32 pc) {
+template <class G>
+void LoopPredictor<G>::predict(UINT32 pc) {
 
   use_loop = false;
   pred = NOT_TAKEN;
 
-  index = lowbits(pc, LOOP_TABLE_INDEX_WIDTH);
-  tag = lowbits((pc >> LOOP_TABLE_INDEX_WIDTH), LOOP_TAG_WIDTH);
+  index = lowbits(pc, geom.loopIndexWidth());
+  tag = lowbits((pc >> geom.loopIndexWidth()), geom.loopTagWidth());
 
   // Check if the tag matches
   if (tag != table[index].tag) {
@@ -160,11 +481,13 @@ void LoopPredictor::predict(UINT32 pc) {
   use_loop = (table[index].ctr == bitmask(LOOP_CONFIDENC_WIDTH));
 }
 
-void LoopPredictor::resetEntry(UINT32 idx) {
+template <class G>
+void LoopPredictor<G>::resetEntry(UINT32 idx) {
   table[idx] = {0, 0, 0, 0, 0};
 }
 
-void LoopPredictor::update(bool resolveDir, bool tage_pred) {
+template <class G>
+void LoopPredictor<G>::update(bool resolveDir, bool tage_pred) {
 
 
   // If the tag does not match
@@ -210,9 +533,22 @@ void LoopPredictor::update(bool resolveDir, bool tage_pred) {
   }
 }
 
-bool LoopPredictor::useLoop() { return use_loop; }
+template <class G>
+bool LoopPredictor<G>::useLoop() { return use_loop; }
 
-bool LoopPredictor::prediction() { return pred; }
+template <class G>
+bool LoopPredictor<G>::prediction() { return pred; }
+
+template <class G>
+UINT64 LoopPredictor<G>::storageBits() {
+  return (UINT64)table.size() * (geom.loopTagWidth() + LOOP_CONFIDENC_WIDTH +
+                                 LOOP_AGE_WIDTH + 2 * LOOP_COUNT_WIDTH);
+}
+
+template <class G>
+void LoopPredictor<G>::checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  cp.array(table.data(), table.size());
+}
 
 // CorrectorFilter
 
@@ -249,21 +585,26 @@ TAGE Result       Check `ctr[index]`
                └─────────────────────────┘
 */
 
-CorrectorFilter::CorrectorFilter() {
-  for (UINT32 i = 0; i < CF_CTR_NUM; i++) {
-    ctr[i] = CF_CTR_MAX / 2; // Initialize to mid-point (strong neutral state)
-    tag_table[i] = 0;
-  }
+template <class G>
+CorrectorFilter<G>::CorrectorFilter(const G &geometry, UINT32 ctr_strong,
+                                    UINT32 ctr_weak)
+    : geom(geometry) {
+  this->ctr_strong = ctr_strong;
+  this->ctr_weak = ctr_weak;
+  // Initialize to mid-point (strong neutral state)
+  ctr.assign(geom.cfCtrNum(), CF_CTR_MAX / 2);
+  tag_table.assign(geom.cfCtrNum(), 0);
 }
 
-bool CorrectorFilter::predict(UINT32 pc, bool tage_result, bool highconf) {
+template <class G>
+bool CorrectorFilter<G>::predict(UINT32 pc, bool tage_result, bool highconf) {
   // If the prediction is high confidence, return the TAGE result
   if (highconf)
     return tage_result;
 
   // Calculate the index and tag for the corrector filter
-  index = (pc * MAGIC_NUMBER + (int)tage_result) % CF_CTR_NUM;
-  tag = lowbits((pc >> 6), CF_TAG_WIDTH);
+  index = (pc * MAGIC_NUMBER + (int)tage_result) % geom.cfCtrNum();
+  tag = lowbits((pc >> 6), geom.cfTagWidth());
 
   // If the tag does not match, return the TAGE result
   if (tag_table[index] != tag) {
@@ -272,7 +613,7 @@ bool CorrectorFilter::predict(UINT32 pc, bool tage_result, bool highconf) {
 
   // If the tag matches and the counter is strong enough, return the corrector
   // filter result
-  if (ctr[index] >= CF_CTR_STRONG || ctr[index] <= CF_CTR_WEAK) {
+  if (ctr[index] >= ctr_strong || ctr[index] <= ctr_weak) {
     return ctr[index] >= CF_CTR_MAX / 2;
   }
 
@@ -280,7 +621,8 @@ bool CorrectorFilter::predict(UINT32 pc, bool tage_result, bool highconf) {
   return tage_result;
 }
 
-void CorrectorFilter::update(bool tage_result, bool resolveDir, bool highconf) {
+template <class G>
+void CorrectorFilter<G>::update(bool tage_result, bool resolveDir, bool highconf) {
   // If the prediction is high confidence, do not update the corrector filter
   if (highconf)
     return;
@@ -311,25 +653,663 @@ void CorrectorFilter::update(bool tage_result, bool resolveDir, bool highconf) {
                           : SatDecrement(ctr[index]);
 }
 
-// PREDICTOR
+template <class G>
+UINT64 CorrectorFilter<G>::storageBits() {
+  // 6-bit counter + tag per entry
+  return (UINT64)geom.cfCtrNum() * (6 + geom.cfTagWidth());
+}
 
-PREDICTOR::PREDICTOR(void) {
-  srand(MAGIC_NUMBER);
-  ghr = 0;
-  clock = 0;
-  use_cf = USE_CF_INIT;
+template <class G>
+void CorrectorFilter<G>::checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  cp.array(ctr.data(), ctr.size());
+  cp.array(tag_table.data(), tag_table.size());
+}
+
+// LocalHistoryTable
+
+LocalHistoryTable::LocalHistoryTable(const PREDICTOR_CONFIG &config,
+                                     bool used) {
+  // Only allocate when a component reads it
+  entry_num = used ? config.local_entry_num : 1;
+  width = config.local_history_width;
+  entry = (UINT16 *)aligned_alloc(
+      64, std::max<size_t>(64, entry_num * sizeof(UINT16)));
+  memset(entry, 0, entry_num * sizeof(UINT16));
+  slot = 0;
+  current = 0;
+}
+
+LocalHistoryTable::~LocalHistoryTable() { free(entry); }
+
+UINT64 LocalHistoryTable::storageBits(bool with_chooser) {
+  return (UINT64)entry_num * (width + (with_chooser ? 2 : 0));
+}
+
+void LocalHistoryTable::checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  cp.check(entry_num, "local_entry_num");
+  cp.check(width, "local_history_width");
+  cp.array(entry, entry_num);
+}
+
+// LocalPredictor
+
+LocalPredictor::LocalPredictor(const PREDICTOR_CONFIG &config) {
+  index_width = config.local_index_width;
+  table.assign(config.local ? 1u << index_width : 0, LOCAL_CTR_INIT);
+  index = 0;
+  ctr = LOCAL_CTR_INIT;
+}
+
+bool LocalPredictor::predict(UINT32 PC, UINT32 local) {
+  // The history spread over the whole index, XORed with the PC
+  UINT32 h = (local * 0x9E3779B1u) >> (32 - index_width);
+  index = (PC ^ (PC >> index_width) ^ h) & bitmask(index_width);
+  ctr = table[index];
+  return ctr > LOCAL_CTR_MAX / 2;
+}
+
+void LocalPredictor::update(bool resolveDir) {
+  table[index] = (resolveDir == TAKEN) ? SatIncrement(ctr, LOCAL_CTR_MAX)
+                                       : SatDecrement(ctr);
+}
+
+UINT64 LocalPredictor::storageBits() {
+  // 3-bit counters
+  return (UINT64)table.size() * 3;
+}
+
+void LocalPredictor::checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  cp.check(index_width, "local_index_width");
+  cp.array(table.data(), table.size());
+}
+
+// StatisticalCorrector
+
+#ifdef TAGE_MATCH_X86
+// Sum of 16 signed counters: flipping the sign bit makes them unsigned
+// with a bias of 128 each, which psadbw sums against zero. The row is
+// packed in registers: a vector load of bytes just stored one at a time
+// would stall on store forwarding.
+static inline INT32 scRowSum(signed char *row, UINT64 lo, UINT64 hi) {
+  __m128i v = _mm_set_epi64x(hi, lo);
+  _mm_store_si128((__m128i *)row, v);
+  v = _mm_xor_si128(v, _mm_set1_epi8((char)0x80));
+  __m128i s = _mm_sad_epu8(v, _mm_setzero_si128());
+  return _mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4) -
+         128 * SC_MAX_TABLE_NUM;
+}
+
+// Every counter of the row one step towards the outcome, saturating at
+// [-ctr_max - 1, ctr_max]
+static inline void scRowTrain(signed char *row, bool taken, INT32 ctr_max) {
+  __m128i v = _mm_load_si128((const __m128i *)row);
+  if (taken) {
+    __m128i limit = _mm_set1_epi8((char)ctr_max);
+    __m128i room = _mm_cmpgt_epi8(limit, v); // -1 where v < limit
+    v = _mm_sub_epi8(v, room);
+  } else {
+    __m128i limit = _mm_set1_epi8((char)(-ctr_max - 1));
+    __m128i room = _mm_cmpgt_epi8(v, limit);
+    v = _mm_add_epi8(v, room);
+  }
+  _mm_store_si128((__m128i *)row, v);
+}
+#else
+static inline INT32 scRowSum(signed char *row, UINT64 lo, UINT64 hi) {
+  INT32 sum = 0;
+  for (UINT32 t = 0; t < SC_MAX_TABLE_NUM; t++) {
+    row[t] = (signed char)((t < 8 ? lo : hi) >> (8 * (t % 8)));
+    sum += row[t];
+  }
+  return sum;
+}
+
+static inline void scRowTrain(signed char *row, bool taken, INT32 ctr_max) {
+  for (UINT32 t = 0; t < SC_MAX_TABLE_NUM; t++) {
+    if (taken) {
+      row[t] += (row[t] < ctr_max);
+    } else {
+      row[t] -= (row[t] > -ctr_max - 1);
+    }
+  }
+}
+#endif
+
+StatisticalCorrector::StatisticalCorrector(const PREDICTOR_CONFIG &config,
+                                           const GlobalHistory *ghr) {
+  this->ghr = ghr;
+  index_width = config.sc_index_width;
+  ctr_max = (1 << (config.sc_ctr_width - 1)) - 1;
+  global_num = config.sc_global_history_width.size();
+  local_num = config.sc_local_history_width.size();
+  use_imli = config.sc_imli;
+  table_num = 1 + global_num + local_num + use_imli;
+
+  if (table_num > SC_MAX_TABLE_NUM) {
+    printf("The statistical corrector has %u tables, at most %u fit. Dying\n",
+           table_num, SC_MAX_TABLE_NUM);
+    exit(-1);
+  }
+
+  for (UINT32 i = 0; i < global_num; i++) {
+    global_width[i] = config.sc_global_history_width[i];
+    global_fold[i].init(global_width[i], index_width);
+  }
+  for (UINT32 i = 0; i < local_num; i++) {
+    local_width[i] = config.sc_local_history_width[i];
+    if (config.sc && local_width[i] > config.local_history_width) {
+      printf("sc_local_history_width %u is longer than local_history_width "
+             "%u. Dying\n", local_width[i], config.local_history_width);
+      exit(-1);
+    }
+  }
+
+  // Only allocate when enabled; a disabled corrector is never called
+  table.assign(config.sc ? (size_t)table_num << index_width : 0, 0);
+  imli = 0;
+  threshold = 2 * table_num + 8;
+  tc = 0;
+  sum = 0;
+  memset(index, 0, sizeof(index));
+  memset(row, 0, sizeof(row));
+}
+
+UINT32 StatisticalCorrector::historyWidth() {
+  UINT32 width = 0;
+  for (UINT32 i = 0; i < global_num; i++) {
+    width = std::max(width, global_width[i]);
+  }
+  return width;
+}
+
+INT32 StatisticalCorrector::predict(UINT32 PC, bool tage_pred,
+                                    bool high_conf, UINT32 local) {
+  UINT32 mask = bitmask(index_width);
+  UINT32 pc = PC ^ (PC >> index_width);
+  UINT32 t = 0;
+
+  // Bias table, one counter per PC, TAGE prediction and confidence
+  index[t++] = ((pc << 2) | (high_conf << 1) | tage_pred) & mask;
+
+  for (UINT32 i = 0; i < global_num; i++, t++) {
+    UINT32 h = global_fold[i].comp;
+    index[t] = (t << index_width) | ((pc ^ h ^ (h << 3)) & mask);
+  }
+
+  for (UINT32 i = 0; i < local_num; i++, t++) {
+    UINT32 h = local & bitmask(local_width[i]);
+    index[t] = (t << index_width) | ((pc ^ h ^ (h >> index_width)) & mask);
+  }
+
+  if (use_imli) {
+    index[t] = (t << index_width) | ((pc ^ (imli << (index_width / 2))) & mask);
+    t++;
+  }
+
+  // Gather into two 8-byte halves, then sum the whole row at once
+  UINT64 half[2] = {0, 0};
+  for (t = 0; t < table_num; t++) {
+    half[t / 8] |= (UINT64)(UINT8)table[index[t]] << (8 * (t % 8));
+  }
+  // Each counter c weighs 2c + 1, so that zero is not a tie
+  sum = 2 * scRowSum(row, half[0], half[1]) + (INT32)table_num;
+  return sum;
+}
+
+void StatisticalCorrector::update(UINT32 PC, bool resolveDir,
+                                  UINT32 branchTarget) {
+  bool pred = sum >= 0;
+  INT32 magnitude = std::abs(sum);
+
+  // Train on mispredictions and on low-confidence sums
+  if (pred != resolveDir || magnitude < threshold) {
+    // The row still holds the counters predict() read: step them all
+    // at once and write them back
+    scRowTrain(row, resolveDir, ctr_max);
+    for (UINT32 t = 0; t < table_num; t++) {
+      table[index[t]] = row[t];
+    }
+  }
+
+  // Threshold adaptation: raise it when mispredicting, lower it when
+  // the updates on correct predictions dominate
+  if (pred != resolveDir) {
+    if (++tc >= (1 << (SC_TC_WIDTH - 1)) - 1) {
+      threshold++;
+      tc = 0;
+    }
+  } else if (magnitude < threshold) {
+    if (--tc <= -(1 << (SC_TC_WIDTH - 1))) {
+      threshold = std::max(threshold - 1, 1);
+      tc = 0;
+    }
+  }
+
+  // The inner-loop iteration count; the local history is shifted by
+  // its owner
+  if (branchTarget < PC) {
+    imli = resolveDir ? SatIncrement(imli, bitmask(SC_IMLI_WIDTH)) : 0;
+  }
+}
 
-  for (UINT32 i = 0; i < TAGE_TABLE_NUM; i++) {
-    tage_list.push_back(
-        std::make_unique<TAGE>(TAGE_TABLE_HISTORY_WIDTH[i], &ghr));
+void StatisticalCorrector::updateHistory(bool resolveDir) {
+  for (UINT32 i = 0; i < global_num; i++) {
+    global_fold[i].update(resolveDir, ghr->bit(global_width[i] - 1));
   }
+}
+
+UINT64 StatisticalCorrector::storageBits() {
+  // counters, IMLI count, threshold and its adaptation counter; the
+  // local histories are counted with their table
+  return (UINT64)table.size() * (32 - __builtin_clz(2 * ctr_max + 1)) +
+         (use_imli ? SC_IMLI_WIDTH : 0) + 12 + SC_TC_WIDTH;
+}
 
-  bp = BasePredictor();
-  lp = LoopPredictor();
-  cf = CorrectorFilter();
+void StatisticalCorrector::checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  cp.check(use_imli, "sc_imli");
+  cp.check(table_num, "statistical corrector table count");
+  cp.check(index_width, "sc_index_width");
+  cp.check(32 - __builtin_clz(2 * ctr_max + 1), "sc_ctr_width");
+  for (UINT32 i = 0; i < global_num; i++) {
+    cp.check(global_width[i], "sc_global_history_width");
+    cp.value(global_fold[i].comp);
+  }
+  for (UINT32 i = 0; i < local_num; i++) {
+    cp.check(local_width[i], "sc_local_history_width");
+  }
+  cp.value(imli);
+  cp.value(threshold);
+  cp.value(tc);
+  cp.array(table.data(), table.size());
 }
 
-bool PREDICTOR::GetPrediction(UINT32 PC) {
+// PREDICTOR_CONFIG
+
+PREDICTOR_CONFIG::PREDICTOR_CONFIG() {
+  base_table_entry_num = BASE_TABLE_ENTRY_NUM;
+  tage_index_width = TAGE_TABLE_INDEX_WIDTH;
+  tage_tag_width = TAGE_TAG_WIDTH;
+  tage_tag_hash = TAGE_TAG_HASH_LEGACY;
+  tage_match = TAGE_MATCH_AUTO;
+  tage_ways = TAGE_WAYS;
+  tage_banked = false;
+  u_reset = U_RESET_BULK;
+  tage_history_width.assign(TAGE_TABLE_HISTORY_WIDTH,
+                            TAGE_TABLE_HISTORY_WIDTH + TAGE_TABLE_NUM);
+  path_history_width = PATH_HISTORY_WIDTH;
+  loop_index_width = LOOP_TABLE_INDEX_WIDTH;
+  loop_tag_width = LOOP_TAG_WIDTH;
+  cf_ctr_num = CF_CTR_NUM;
+  cf_tag_width = CF_TAG_WIDTH;
+  cf_ctr_strong = CF_CTR_STRONG;
+  cf_ctr_weak = CF_CTR_WEAK;
+  use_cf_threshold = USE_CF_THRESHOLD;
+  local_entry_num = LOCAL_ENTRY_NUM;
+  local_history_width = LOCAL_HISTORY_WIDTH;
+  local = false;
+  local_index_width = LOCAL_INDEX_WIDTH;
+  sc = false;
+  sc_index_width = SC_INDEX_WIDTH;
+  sc_ctr_width = SC_CTR_WIDTH;
+  sc_global_history_width.assign(std::begin(SC_GLOBAL_HISTORY_WIDTH),
+                                 std::end(SC_GLOBAL_HISTORY_WIDTH));
+  sc_local_history_width.assign(std::begin(SC_LOCAL_HISTORY_WIDTH),
+                                std::end(SC_LOCAL_HISTORY_WIDTH));
+  sc_imli = true;
+  seed = MAGIC_NUMBER;
+}
+
+static bool parseUint(const char *value, UINT32 min, UINT32 max,
+                      UINT32 *out) {
+  char *end;
+  unsigned long v = strtoul(value, &end, 0);
+  if (end == value || *end != '\0' || v < min || v > max) {
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+// "w:w:...", at most max_num widths in [1, max_width]
+static bool parseWidthList(const char *value, UINT32 max_num,
+                           UINT32 max_width, std::vector<UINT32> *out) {
+  std::vector<UINT32> widths;
+  std::string list(value);
+  size_t pos = 0;
+  while (true) {
+    size_t end = list.find(':', pos);
+    std::string item = list.substr(pos, end - pos);
+    UINT32 width;
+    if (!parseUint(item.c_str(), 1, max_width, &width) ||
+        widths.size() == max_num) {
+      return false;
+    }
+    widths.push_back(width);
+    if (end == std::string::npos) {
+      break;
+    }
+    pos = end + 1;
+  }
+  *out = widths;
+  return true;
+}
+
+static bool parseSwitch(const char *value, bool *out) {
+  if (!strcmp(value, "on")) {
+    *out = true;
+  } else if (!strcmp(value, "off")) {
+    *out = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool PREDICTOR_CONFIG::set(const char *key, const char *value) {
+  if (!strcmp(key, "base_table_entry_num")) {
+    return parseUint(value, 1, 1 << 24, &base_table_entry_num);
+  }
+  if (!strcmp(key, "tage_index_width")) {
+    return parseUint(value, 1, 24, &tage_index_width);
+  }
+  if (!strcmp(key, "tage_tag_width")) {
+    // tags are stored in a UINT16
+    return parseUint(value, 1, 16, &tage_tag_width);
+  }
+  if (!strcmp(key, "tage_tag_hash")) {
+    if (!strcmp(value, "legacy")) {
+      tage_tag_hash = TAGE_TAG_HASH_LEGACY;
+    } else if (!strcmp(value, "folded")) {
+      tage_tag_hash = TAGE_TAG_HASH_FOLDED;
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (!strcmp(key, "tage_match")) {
+    static const char *names[] = {"auto", "scalar", "sse2", "avx2"};
+    for (UINT32 i = 0; i < 4; i++) {
+      if (!strcmp(value, names[i])) {
+        tage_match = i;
+        return true;
+      }
+    }
+    return false;
+  }
+  if (!strcmp(key, "tage_ways")) {
+    if (!parseUint(value, 1, TAGE_MAX_WAYS, &tage_ways)) {
+      return false;
+    }
+    // a set is a power of two of entries
+    return (tage_ways & (tage_ways - 1)) == 0;
+  }
+  if (!strcmp(key, "tage_banked")) {
+    return parseSwitch(value, &tage_banked);
+  }
+  if (!strcmp(key, "u_reset")) {
+    if (!strcmp(value, "bulk")) {
+      u_reset = U_RESET_BULK;
+    } else if (!strcmp(value, "incremental")) {
+      u_reset = U_RESET_INCREMENTAL;
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (!strcmp(key, "tage_history_width")) {
+    // one width per table, separated by ':'; the list sets the table count
+    return parseWidthList(value, TAGE_MAX_TABLE_NUM, TAGE_MAX_HISTORY_WIDTH,
+                          &tage_history_width);
+  }
+  if (!strcmp(key, "tage_history_geometric")) {
+    // "num:min:max", num widths in a geometric series from min to max
+    UINT32 num, min, max;
+    char extra;
+    if (sscanf(value, "%u:%u:%u%c", &num, &min, &max, &extra) != 3 ||
+        num < 2 || num > TAGE_MAX_TABLE_NUM || min < 1 || min > max ||
+        max > TAGE_MAX_HISTORY_WIDTH) {
+      return false;
+    }
+    tage_history_width.clear();
+    for (UINT32 i = 0; i < num; i++) {
+      double ratio = (double)i / (num - 1);
+      tage_history_width.push_back(
+          (UINT32)(min * pow((double)max / min, ratio) + 0.5));
+    }
+    return true;
+  }
+  if (!strcmp(key, "path_history_width")) {
+    return parseUint(value, 0, PATH_MAX_HISTORY_WIDTH, &path_history_width);
+  }
+  if (!strcmp(key, "loop_index_width")) {
+    return parseUint(value, 1, 20, &loop_index_width);
+  }
+  if (!strcmp(key, "loop_tag_width")) {
+    // LoopEntry::tag is a UINT16
+    return parseUint(value, 1, 16, &loop_tag_width);
+  }
+  if (!strcmp(key, "cf_ctr_num")) {
+    return parseUint(value, 1, 1 << 24, &cf_ctr_num);
+  }
+  if (!strcmp(key, "cf_tag_width")) {
+    // CorrectorFilter tags are UINT8
+    return parseUint(value, 1, 8, &cf_tag_width);
+  }
+  if (!strcmp(key, "cf_ctr_strong")) {
+    return parseUint(value, 0, CF_CTR_MAX, &cf_ctr_strong);
+  }
+  if (!strcmp(key, "cf_ctr_weak")) {
+    return parseUint(value, 0, CF_CTR_MAX, &cf_ctr_weak);
+  }
+  if (!strcmp(key, "use_cf_threshold")) {
+    return parseUint(value, 0, USE_CF_MAX, &use_cf_threshold);
+  }
+  if (!strcmp(key, "local_entry_num")) {
+    if (!parseUint(value, 1, 1 << 24, &local_entry_num)) {
+      return false;
+    }
+    // indexed with a mask
+    return (local_entry_num & (local_entry_num - 1)) == 0;
+  }
+  if (!strcmp(key, "local_history_width")) {
+    // shares a UINT16 with the chooser
+    return parseUint(value, 1, LOCAL_MAX_HISTORY_WIDTH, &local_history_width);
+  }
+  if (!strcmp(key, "local")) {
+    return parseSwitch(value, &local);
+  }
+  if (!strcmp(key, "local_index_width")) {
+    return parseUint(value, 1, 24, &local_index_width);
+  }
+  if (!strcmp(key, "sc")) {
+    return parseSwitch(value, &sc);
+  }
+  if (!strcmp(key, "sc_index_width")) {
+    return parseUint(value, 2, 24, &sc_index_width);
+  }
+  if (!strcmp(key, "sc_ctr_width")) {
+    // counters are signed chars
+    return parseUint(value, 2, 8, &sc_ctr_width);
+  }
+  if (!strcmp(key, "sc_global_history_width")) {
+    // the table count limit is checked when the corrector is built
+    return parseWidthList(value, SC_MAX_TABLE_NUM, TAGE_MAX_HISTORY_WIDTH,
+                          &sc_global_history_width);
+  }
+  if (!strcmp(key, "sc_local_history_width")) {
+    return parseWidthList(value, SC_MAX_TABLE_NUM, LOCAL_MAX_HISTORY_WIDTH,
+                          &sc_local_history_width);
+  }
+  if (!strcmp(key, "sc_imli")) {
+    return parseSwitch(value, &sc_imli);
+  }
+  if (!strcmp(key, "seed")) {
+    return parseUint(value, 1, 0xFFFFFFFF, &seed);
+  }
+  return false;
+}
+
+bool PREDICTOR_CONFIG::parse(const char *spec) {
+  std::string list(spec);
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string item = list.substr(pos, end - pos);
+    size_t eq = item.find('=');
+    if (eq == std::string::npos ||
+        !set(item.substr(0, eq).c_str(), item.substr(eq + 1).c_str())) {
+      printf("Invalid predictor option '%s'\n", item.c_str());
+      return false;
+    }
+    pos = end + 1;
+  }
+  return true;
+}
+
+bool PREDICTOR_CONFIG::load(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    printf("Unable to open the config file %s\n", filename);
+    return false;
+  }
+
+  char line[1024];
+  UINT32 line_num = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), file)) {
+    line_num++;
+
+    // Strip comments and whitespace, keep "key=value"
+    std::string item;
+    for (char *c = line; *c && *c != '#'; c++) {
+      if (!isspace((unsigned char)*c)) {
+        item += *c;
+      }
+    }
+    if (item.empty()) {
+      continue;
+    }
+
+    size_t eq = item.find('=');
+    if (eq == std::string::npos ||
+        !set(item.substr(0, eq).c_str(), item.substr(eq + 1).c_str())) {
+      printf("%s:%u: invalid predictor option '%s'\n", filename, line_num,
+             item.c_str());
+      ok = false;
+    }
+  }
+
+  fclose(file);
+  return ok;
+}
+
+// PREDICTOR_CHECKPOINT
+
+PREDICTOR_CHECKPOINT::PREDICTOR_CHECKPOINT(const char *fileName, bool save) {
+  file_name = fileName;
+  saving = save;
+  offset = 0;
+  if ((file = fopen(fileName, save ? "wb" : "rb")) == NULL) {
+    printf("Unable to open the state file %s. Dying\n", fileName);
+    exit(-1);
+  }
+
+  char magic[8];
+  UINT32 version = PREDICTOR_STATE_VERSION;
+  memcpy(magic, PREDICTOR_STATE_MAGIC, sizeof(magic));
+  bytes(magic, sizeof(magic));
+  if (memcmp(magic, PREDICTOR_STATE_MAGIC, sizeof(magic)) != 0) {
+    printf("%s is not a predictor state file. Dying\n", fileName);
+    exit(-1);
+  }
+  value(version);
+  if (version != PREDICTOR_STATE_VERSION) {
+    printf("Unsupported predictor state version %u. Dying\n", version);
+    exit(-1);
+  }
+}
+
+PREDICTOR_CHECKPOINT::~PREDICTOR_CHECKPOINT() {
+  if (fclose(file) != 0 && saving) {
+    printf("Unable to write the state file %s. Dying\n", file_name);
+    exit(-1);
+  }
+}
+
+void PREDICTOR_CHECKPOINT::bytes(void *data, size_t size) {
+  size_t done = saving ? fwrite(data, 1, size, file)
+                       : fread(data, 1, size, file);
+  if (done != size) {
+    printf(saving ? "Unable to write the state file %s. Dying\n"
+                  : "Truncated state file %s. Dying\n", file_name);
+    exit(-1);
+  }
+  offset += size;
+}
+
+void PREDICTOR_CHECKPOINT::align() {
+  char padding[PREDICTOR_STATE_ALIGN] = {};
+  size_t pad = (PREDICTOR_STATE_ALIGN - offset % PREDICTOR_STATE_ALIGN) %
+               PREDICTOR_STATE_ALIGN;
+  bytes(padding, pad);
+}
+
+void PREDICTOR_CHECKPOINT::check(UINT32 v, const char *what) {
+  UINT32 saved = v;
+  value(saved);
+  if (saved != v) {
+    printf("State file %s was saved with %s %u, this predictor has %u. "
+           "Dying\n", file_name, what, saved, v);
+    exit(-1);
+  }
+}
+
+// TAGE_SC_L
+
+template <class G>
+TAGE_SC_L<G>::TAGE_SC_L(void) : TAGE_SC_L(PREDICTOR_CONFIG()) {}
+
+template <class G>
+TAGE_SC_L<G>::TAGE_SC_L(const PREDICTOR_CONFIG &config)
+    : geom(config),
+      tage(geom, config, &ghr, &path),
+      bp(geom), lp(geom), cf(geom, config.cf_ctr_strong, config.cf_ctr_weak),
+      sc(config, &ghr), lht(config, config.local || config.sc),
+      local(config) {
+  rand_state = config.seed;
+  clock = 0;
+  u_reset = config.u_reset;
+  u_reset_cursor = 0;
+  use_cf = USE_CF_INIT;
+  use_cf_threshold = config.use_cf_threshold;
+  use_path = config.path_history_width > 0;
+  use_sc = config.sc;
+  use_local = config.local;
+  use_local_history = use_local || use_sc;
+  sc_override = false;
+  local_prediction = false;
+  local_disagrees = false;
+  local_override = false;
+  local_history = 0;
+  ghr_width = 0;
+  tage_hits = 0;
+  memset(&counters, 0, sizeof(counters));
+
+  for (UINT32 i = 0; i < geom.tageTableNum(); i++) {
+    ghr_width = std::max(ghr_width, config.tage_history_width[i]);
+  }
+  if (use_sc) {
+    ghr_width = std::max(ghr_width, sc.historyWidth());
+  }
+  ghr.init(ghr_width);
+  path.init(config.path_history_width);
+}
+
+template <class G>
+bool TAGE_SC_L<G>::GetPrediction(UINT32 PC) {
   // Get prediction from the base predictor
   first_prediction = bp.predict(PC);
 
@@ -338,25 +1318,56 @@ bool PREDICTOR::GetPrediction(UINT32 PC) {
   second_predictor = -1;
   second_prediction = first_prediction;
 
-  // Iterate through TAGE tables to find a matching entry
-  for (UINT32 i = 0; i < TAGE_TABLE_NUM; i++) {
-    if (tage_list[i]->match(PC)) {
-      // Update second predictor component and prediction
-      second_predictor = first_predictor;
-      second_prediction = first_prediction;
-
-      // Update tage component and prediction
-      first_predictor = i;
-      first_prediction = tage_list[i]->predict();
+  // The longest hitting table provides the prediction, the next longest
+  // (or the base predictor) is the alternate
+  UINT32 hits = tage.match(PC);
+  tage_hits = hits;
+  if (hits != 0) {
+    first_predictor = 31 - __builtin_clz(hits);
+    first_prediction = tage.predict(first_predictor);
+    hits &= ~(1u << first_predictor);
+    if (hits != 0) {
+      second_predictor = 31 - __builtin_clz(hits);
+      second_prediction = tage.predict(second_predictor);
     }
   }
 
   // Determine high confidence status
   high_conf = (first_predictor == -1) ? bp.highConf()
-                                      : tage_list[first_predictor]->highConf();
+                                      : tage.highConf(first_predictor);
 
   tage_prediction = first_prediction;
 
+  if (use_local_history) {
+    local_history = lht.lookup(PC);
+  }
+
+  // The statistical corrector reverts the TAGE prediction when its sum
+  // disagrees, unless TAGE is confident and the sum is not
+  sc_override = false;
+  if (use_sc) {
+    INT32 sum = sc.predict(PC, first_prediction, high_conf, local_history);
+    if ((sum >= 0) != first_prediction &&
+        (!high_conf || std::abs(sum) >= sc.getThreshold() / 2)) {
+      tage_prediction = sum >= 0;
+      sc_override = true;
+    }
+  }
+
+  // A confident local prediction replaces a weak TAGE one where the
+  // branch's chooser has found local history the better guide. Without
+  // branches: the host predicts these outcomes poorly
+  local_disagrees = false;
+  local_override = false;
+  if (use_local) {
+    local_prediction = local.predict(PC, local_history);
+    local_disagrees = !high_conf & local.highConf() &
+                      (local_prediction != tage_prediction);
+    local_override =
+        local_disagrees & (lht.chooser() >= LOCAL_CHOOSER_THRESHOLD);
+    tage_prediction ^= local_override;
+  }
+
 #ifdef CF_ON
   // Get prediction from the corrector filter
   cf_prediction = cf.predict(PC, tage_prediction, high_conf);
@@ -374,15 +1385,18 @@ bool PREDICTOR::GetPrediction(UINT32 PC) {
 
 #ifdef CF_ON
   // Return the prediction from the tage component or the corrector filter
-  return (use_cf > USE_CF_THRESHOLD) ? cf_prediction : tage_prediction;
+  return (use_cf > use_cf_threshold) ? cf_prediction : tage_prediction;
 #else
   // Return the prediction from the tage component
   return tage_prediction;
 #endif
 }
 
-void PREDICTOR::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir,
+template <class G>
+void TAGE_SC_L<G>::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir,
                                 UINT32 branchTarget) {
+  Count(resolveDir);
+
 #ifdef LOOP_ON
   // Update the loop predictor
   lp.update(resolveDir, first_prediction);
@@ -392,63 +1406,62 @@ void PREDICTOR::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir,
   if (first_predictor == -1) {
     bp.update(resolveDir);
   } else {
-    tage_list[first_predictor]->updateHit(resolveDir);
+    tage.updateHit(first_predictor, resolveDir);
   }
 
   // Allocate new entry if prediction is incorrect and not the last table
-  if (resolveDir != first_prediction && first_predictor != TAGE_TABLE_NUM - 1) {
-    // Vector to store indices of unallocated entries
-    std::vector<int> unalloc_indices;
-
-    // Identify unallocated entries
-    for (UINT32 i = first_predictor + 1; i < TAGE_TABLE_NUM; ++i) {
-      if (tage_list[i]->getU() == 0) {
-        unalloc_indices.push_back(i);
-      }
-    }
+  if (resolveDir != first_prediction && first_predictor != (INT32)geom.tageTableNum() - 1) {
+    // Tables above the provider, and those among them with a free entry
+    UINT32 above = lowMask(geom.tageTableNum()) & ~lowMask(first_predictor + 1);
+    UINT32 candidates = tage.uZeroMask() & above;
 
-    if (unalloc_indices.empty()) {
+    if (candidates == 0) {
       // No unallocated entries: decrement all U counters in the range
-      for (UINT32 i = first_predictor + 1; i < TAGE_TABLE_NUM; ++i) {
-        tage_list[i]->updateMiss();
+      for (UINT32 i = first_predictor + 1; i < geom.tageTableNum(); ++i) {
+        tage.updateMiss(i);
       }
+      counters.alloc_failure++;
     } else {
-      // Allocate an entry probabilistically
-      int total_probability = bitmask(unalloc_indices.size());
-      int random_value = rand() % total_probability;
-
-      // Determine the chosen index based on probabilities
-      int chosen_idx = -1;
-      for (UINT32 i = 0; i < unalloc_indices.size(); ++i) {
-        if (random_value >= bitmask(i) && random_value < bitmask((i + 1))) {
-          chosen_idx = unalloc_indices[unalloc_indices.size() - 1 - i];
-          break;
-        }
+      // Allocate an entry probabilistically: of c candidates, the k-th
+      // shortest is chosen with probability 2^(c-1-k) / (2^c - 1)
+      UINT32 c = __builtin_popcount(candidates);
+      UINT32 r = nextRandom() % lowMask(c);
+      UINT32 k = c - 1 - (31 - __builtin_clz(r + 1));
+      while (k--) {
+        candidates &= candidates - 1;
       }
 
       // Allocate the chosen entry
-      if (chosen_idx != -1) {
-        tage_list[chosen_idx]->updateMissNewEntry(resolveDir);
-      }
+      tage.updateMissNewEntry(__builtin_ctz(candidates), resolveDir);
+      counters.alloc_success++;
     }
   }
 
   // Update u counter for the tage component
   if (second_prediction != first_prediction && first_predictor != -1) {
-    tage_list[first_predictor]->updateU(resolveDir, first_prediction);
+    tage.updateU(first_predictor, resolveDir, first_prediction);
   }
 
   // Periodically reset u counters
   clock++;
-  if (clock == CLOCK_HIGH) {
-    for (UINT32 i = 0; i < TAGE_TABLE_NUM; i++) {
-      tage_list[i]->resetU(1);
-    }
+  if (u_reset == U_RESET_INCREMENTAL) {
+    // Age the arena a slice at a time, so that the mask-1 sweep ends at
+    // CLOCK_HIGH and the mask-2 sweep at CLOCK_MAX, as in bulk mode
+    bool first_half = clock <= CLOCK_HIGH;
+    UINT32 phase = first_half ? clock : clock - CLOCK_HIGH;
+    UINT32 end = ((UINT64)phase * tage.entryNum()) / CLOCK_HIGH;
+    tage.resetU(first_half ? 1 : 2, u_reset_cursor, end);
+    u_reset_cursor = (end == tage.entryNum()) ? 0 : end;
+    counters.u_resets += (end == tage.entryNum());
+  } else if (clock == CLOCK_HIGH) {
+    tage.resetU(1, 0, tage.entryNum());
+    counters.u_resets++;
   }
 
   if (clock == CLOCK_MAX) {
-    for (UINT32 i = 0; i < TAGE_TABLE_NUM; i++) {
-      tage_list[i]->resetU(2);
+    if (u_reset == U_RESET_BULK) {
+      tage.resetU(2, 0, tage.entryNum());
+      counters.u_resets++;
     }
     clock = 0;
   }
@@ -462,14 +1475,212 @@ void PREDICTOR::UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir,
   }
 #endif
 
-  // Update global history register
-  ghr <<= 1;
-  if (resolveDir) {
-    ghr += 1;
+  if (use_sc) {
+    sc.update(PC, resolveDir, branchTarget);
+    sc.updateHistory(resolveDir);
+  }
+
+  // Train the local component and its chooser, then shift the outcome
+  // into the branch's history, all in the entry read by GetPrediction
+  if (use_local_history) {
+    UINT32 chooser = lht.chooser();
+    if (use_local) {
+      local.update(resolveDir);
+      // towards whichever was right when they disagreed
+      bool right = local_prediction == resolveDir;
+      chooser += local_disagrees & right & (chooser < 3);
+      chooser -= local_disagrees & !right & (chooser > 0);
+    }
+    lht.update(resolveDir, chooser);
+  }
+
+  // Update the folded histories, then the global history register
+  tage.updateHistory(resolveDir);
+  ghr.push(resolveDir);
+  if (use_path && resolveDir) {
+    path.push(PC, branchTarget);
+  }
+}
+
+template <class G>
+UINT32 TAGE_SC_L<G>::GetProvider() {
+#ifdef LOOP_ON
+  if (lp.useLoop()) {
+    return PROVIDER_LOOP;
+  }
+#endif
+#ifdef CF_ON
+  if (use_cf > use_cf_threshold && cf_prediction != tage_prediction) {
+    return PROVIDER_CF;
+  }
+#endif
+  if (local_override) {
+    return PROVIDER_LOCAL;
+  }
+  if (sc_override) {
+    return PROVIDER_SC;
+  }
+  return (first_predictor == -1) ? PROVIDER_BASE
+                                 : PROVIDER_TAGE + first_predictor;
+}
+
+template <class G>
+void TAGE_SC_L<G>::Count(bool resolveDir) {
+  // Branch-free where the outcome is data dependent: this runs for every
+  // branch, on streams the host predicts poorly
+  for (UINT32 t = 0; t < geom.tageTableNum(); t++) {
+    counters.tage_hits[t] += (tage_hits >> t) & 1;
+  }
+  counters.provided[first_predictor + 1]++;
+  counters.provided_wrong[first_predictor + 1] += (first_prediction != resolveDir);
+
+  // Overrides as GetPrediction decided them: the loop predictor first,
+  // then the corrector filter
+  bool loop_used = false;
+#ifdef LOOP_ON
+  loop_used = lp.useLoop();
+  if (loop_used) {
+    counters.loop_used++;
+    if (lp.prediction() != tage_prediction) {
+      counters.loop_overrides++;
+      counters.loop_overrides_right += (lp.prediction() == resolveDir);
+    }
+  }
+#endif
+#ifdef CF_ON
+  if (!loop_used && use_cf > use_cf_threshold &&
+      cf_prediction != tage_prediction) {
+    counters.cf_overrides++;
+    counters.cf_overrides_right += (cf_prediction == resolveDir);
+    return;
+  }
+#endif
+  if (!loop_used && local_override) {
+    counters.local_overrides++;
+    counters.local_overrides_right += (tage_prediction == resolveDir);
+  } else if (!loop_used && sc_override) {
+    counters.sc_overrides++;
+    counters.sc_overrides_right += (tage_prediction == resolveDir);
+  }
+}
+
+template <class G>
+void TAGE_SC_L<G>::PrintCounters() {
+  char name[32];
+  for (UINT32 t = 0; t < geom.tageTableNum(); t++) {
+    snprintf(name, sizeof(name), "TAGE_T%u_HITS", t);
+    printf("%-21s\t : %10llu\n", name, counters.tage_hits[t]);
+    snprintf(name, sizeof(name), "TAGE_T%u_PROVIDED", t);
+    printf("%-21s\t : %10llu\n", name, counters.provided[1 + t]);
+    snprintf(name, sizeof(name), "TAGE_T%u_WRONG", t);
+    printf("%-21s\t : %10llu\n", name, counters.provided_wrong[1 + t]);
+  }
+  printf("%-21s\t : %10llu\n", "BASE_PROVIDED", counters.provided[0]);
+  printf("%-21s\t : %10llu\n", "BASE_WRONG", counters.provided_wrong[0]);
+  printf("%-21s\t : %10llu\n", "LOOP_USED", counters.loop_used);
+  printf("%-21s\t : %10llu\n", "LOOP_OVERRIDES", counters.loop_overrides);
+  printf("%-21s\t : %10llu\n", "LOOP_OVERRIDES_RIGHT",
+         counters.loop_overrides_right);
+  printf("%-21s\t : %10llu\n", "CF_OVERRIDES", counters.cf_overrides);
+  printf("%-21s\t : %10llu\n", "CF_OVERRIDES_RIGHT",
+         counters.cf_overrides_right);
+  printf("%-21s\t : %10llu\n", "SC_OVERRIDES", counters.sc_overrides);
+  printf("%-21s\t : %10llu\n", "SC_OVERRIDES_RIGHT",
+         counters.sc_overrides_right);
+  printf("%-21s\t : %10llu\n", "LOCAL_OVERRIDES", counters.local_overrides);
+  printf("%-21s\t : %10llu\n", "LOCAL_OVERRIDES_RIGHT",
+         counters.local_overrides_right);
+  printf("%-21s\t : %10llu\n", "ALLOC_SUCCESS", counters.alloc_success);
+  printf("%-21s\t : %10llu\n", "ALLOC_FAILURE", counters.alloc_failure);
+  printf("%-21s\t : %10llu\n", "U_RESETS", counters.u_resets);
+}
+
+template <class G>
+UINT64 TAGE_SC_L<G>::GetStorageBits() {
+  UINT64 bits = bp.storageBits() + tage.storageBits();
+#ifdef LOOP_ON
+  bits += lp.storageBits();
+#endif
+#ifdef CF_ON
+  bits += cf.storageBits() + 4; // + use_cf
+#endif
+  if (use_sc) {
+    bits += sc.storageBits();
+  }
+  if (use_local_history) {
+    bits += lht.storageBits(use_local);
+  }
+  if (use_local) {
+    bits += local.storageBits();
+  }
+  // Global and path history actually used, plus the 19-bit u-reset clock
+  bits += ghr_width + tage.pathWidth() + 19;
+  if (u_reset == U_RESET_INCREMENTAL) {
+    // + the aging cursor
+    bits += 32 - __builtin_clz(tage.entryNum());
+  }
+  return bits;
+}
+
+template <class G>
+void TAGE_SC_L<G>::Checkpoint(PREDICTOR_CHECKPOINT &cp) {
+  // Snapshots only load into the geometry they were taken with
+  cp.check(geom.baseTableEntryNum(), "base_table_entry_num");
+  cp.check(geom.tageTableNum(), "TAGE table count");
+  cp.check(geom.tageIndexWidth(), "tage_index_width");
+  cp.check(geom.tageTagWidth(), "tage_tag_width");
+  cp.check(geom.loopIndexWidth(), "loop_index_width");
+  cp.check(geom.loopTagWidth(), "loop_tag_width");
+  cp.check(geom.cfCtrNum(), "cf_ctr_num");
+  cp.check(geom.cfTagWidth(), "cf_tag_width");
+
+  cp.check(u_reset, "u_reset");
+  cp.check(use_sc, "sc");
+  cp.check(use_local, "local");
+  cp.check(tage.pathWidth(), "path_history_width");
+
+  cp.value(clock);
+  cp.value(u_reset_cursor);
+  cp.value(use_cf);
+  cp.value(rand_state);
+
+  ghr.checkpoint(cp);
+  path.checkpoint(cp);
+  bp.checkpoint(cp);
+  tage.checkpoint(cp);
+  lp.checkpoint(cp);
+  cf.checkpoint(cp);
+  if (use_sc) {
+    sc.checkpoint(cp);
+  }
+  if (use_local_history) {
+    lht.checkpoint(cp);
+  }
+  if (use_local) {
+    local.checkpoint(cp);
   }
 }
 
-void PREDICTOR::TrackOtherInst(UINT32 PC, OpType opType, UINT32 branchTarget) {
-  // No operation for other instructions
-  return;
+template <class G>
+void TAGE_SC_L<G>::SaveState(const char *fileName) {
+  PREDICTOR_CHECKPOINT cp(fileName, true);
+  Checkpoint(cp);
 }
+
+template <class G>
+void TAGE_SC_L<G>::LoadState(const char *fileName) {
+  PREDICTOR_CHECKPOINT cp(fileName, false);
+  Checkpoint(cp);
+}
+
+// Both geometries are built here so the template definitions can stay in
+// this file
+#define INSTANTIATE_PREDICTOR(G)                                            \
+  template class BasePredictor<G>;                                         \
+  template class TAGE<G>;                                                  \
+  template class LoopPredictor<G>;                                         \
+  template class CorrectorFilter<G>;                                       \
+  template class TAGE_SC_L<G>;
+
+INSTANTIATE_PREDICTOR(DYNAMIC_GEOMETRY)
+INSTANTIATE_PREDICTOR(GEOMETRY_32KB)
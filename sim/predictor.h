@@ -26,7 +26,6 @@
 #define INT8 char
 #define UINT8 unsigned char
 #define UINT16 unsigned short int
-#define UINT128 __uint128_t
 
 #define bitmask(a) ((1 << a) - 1)
 #define lowbits(a, b) (a & bitmask(b))
@@ -52,7 +51,7 @@
 #define TAGE_CTR_WEAK 2
 #define TAGE_U_MAX 3
 #define TAGE_WEAK_CORRECT 4
-const UINT32 TAGE_TABLE_HISTORY_WIDTH[TAGE_TABLE_NUM] = {
+inline constexpr UINT32 TAGE_TABLE_HISTORY_WIDTH[TAGE_TABLE_NUM] = {
       5, 16, 37, 91}; // History widths for TAGE tables
 
 #define USE_CF_INIT 8
@@ -72,16 +71,330 @@ const UINT32 TAGE_TABLE_HISTORY_WIDTH[TAGE_TABLE_NUM] = {
 #define CF_TAG_WIDTH 7
 #define CF_CTR_NUM 252
 
-#define CLOCK_HIGH 1 << 18
-#define CLOCK_MAX 1 << 19
+#define CLOCK_HIGH (1 << 18)
+#define CLOCK_MAX (1 << 19)
 
-// Structure for TAGE table entries
+// Per-PC local histories, shared by the local component and the
+// statistical corrector, and the local component (off by default,
+// PREDICTOR_CONFIG::local)
+#define LOCAL_ENTRY_NUM 256
+#define LOCAL_HISTORY_WIDTH 11
+#define LOCAL_INDEX_WIDTH 12
+#define LOCAL_CTR_INIT 4
+#define LOCAL_CTR_MAX 7
+#define LOCAL_CHOOSER_SHIFT 14 // 2-bit chooser above the history
+#define LOCAL_CHOOSER_THRESHOLD 2
+
+// Path history, off by default (PREDICTOR_CONFIG::path_history_width)
+#define PATH_HISTORY_WIDTH 0
+#define PATH_MAX_HISTORY_WIDTH 32
+#define PATH_INSERT_WIDTH 2 // bits shifted in per taken branch
+
+// Statistical corrector, off by default (PREDICTOR_CONFIG::sc)
+#define SC_INDEX_WIDTH 10
+#define SC_CTR_WIDTH 6
+#define SC_IMLI_WIDTH 8 // saturating inner-loop iteration count
+#define SC_TC_WIDTH 7   // threshold adaptation counter
+inline constexpr UINT32 SC_GLOBAL_HISTORY_WIDTH[] = {4, 9, 15, 24, 40};
+inline constexpr UINT32 SC_LOCAL_HISTORY_WIDTH[] = {3, 6, 11};
+
+
+// TAGE tag hashes (PREDICTOR_CONFIG::tage_tag_hash)
+#define TAGE_TAG_HASH_LEGACY 0 // low tag-width ghr bits + PC * LARGE_PRIME
+#define TAGE_TAG_HASH_FOLDED 1 // PC ^ fold(h, w) ^ (fold(h, w - 1) << 1)
+
+// TAGE tag match implementations (PREDICTOR_CONFIG::tage_match)
+#define TAGE_MATCH_AUTO 0   // best one this CPU supports
+#define TAGE_MATCH_SCALAR 1 // one compare per table
+#define TAGE_MATCH_SSE2 2   // 4 tables per compare
+#define TAGE_MATCH_AVX2 3   // 8 tables per gather + compare
+
+// TAGE table organisation (PREDICTOR_CONFIG::tage_ways, tage_banked)
+#define TAGE_WAYS 1     // direct mapped
+#define TAGE_MAX_WAYS 4 // a 16-byte set, never straddling a cache line
+
+// TAGE usefulness aging (PREDICTOR_CONFIG::u_reset)
+#define U_RESET_BULK 0        // whole arena at CLOCK_HIGH and CLOCK_MAX
+#define U_RESET_INCREMENTAL 1 // a slice per update, same period
+
+// Limits on the runtime geometry
+#define TAGE_MAX_TABLE_NUM 32 // a multiple of the SIMD match width
+#define TAGE_MAX_HISTORY_WIDTH 4096
+#define SC_MAX_TABLE_NUM 16 // one 16-byte SIMD row of counters
+#define LOCAL_MAX_HISTORY_WIDTH LOCAL_CHOOSER_SHIFT
+
+// Component that made the final prediction (TAGE_SC_L::GetProvider)
+#define PROVIDER_BASE 0
+#define PROVIDER_LOOP 1
+#define PROVIDER_CF 2   // only when it overrode TAGE
+#define PROVIDER_SC 3   // only when it overrode TAGE
+#define PROVIDER_LOCAL 4 // only when it overrode TAGE
+#define PROVIDER_TAGE 5 // + the provider table
+#define PROVIDER_NUM (PROVIDER_TAGE + TAGE_MAX_TABLE_NUM)
+
+// Predictor geometry and tuning, chosen per instance at construction so
+// that one binary can run a whole parameter sweep. Defaults are the
+// #defines above. Options are set as key=value pairs, either on the
+// command line or from a config file with one pair per line.
+struct PREDICTOR_CONFIG {
+  UINT32 base_table_entry_num;
+
+  UINT32 tage_index_width;
+  UINT32 tage_tag_width;
+  UINT32 tage_tag_hash;
+  UINT32 tage_match;
+  UINT32 tage_ways;  // 1, 2 or 4
+  bool tage_banked; // tables interleaved over single-ported banks
+  UINT32 u_reset;
+  std::vector<UINT32> tage_history_width; // one per table
+  UINT32 path_history_width; // 0: no path history in the TAGE hashes
+
+  UINT32 loop_index_width;
+  UINT32 loop_tag_width;
+
+  UINT32 cf_ctr_num;
+  UINT32 cf_tag_width;
+  UINT32 cf_ctr_strong;
+  UINT32 cf_ctr_weak;
+  UINT32 use_cf_threshold;
+
+  UINT32 local_entry_num; // per-PC histories, a power of two
+  UINT32 local_history_width;
+  bool local; // local-history component next to TAGE
+  UINT32 local_index_width;
+
+  bool sc; // statistical corrector on top of TAGE
+  UINT32 sc_index_width;
+  UINT32 sc_ctr_width;
+  std::vector<UINT32> sc_global_history_width; // one GEHL table per width
+  std::vector<UINT32> sc_local_history_width;  // one table per width
+  bool sc_imli;
+
+  UINT32 seed; // allocation PRNG seed, nonzero
+
+  PREDICTOR_CONFIG();
+  bool set(const char *key, const char *value);
+  bool parse(const char *spec);     // "key=value,key=value,..."
+  bool load(const char *filename); // "key = value" lines, '#' comments
+
+  // TrackOtherInst matters: filtered replays, which skip it, would
+  // predict differently
+  bool needsOtherInst() const { return path_history_width > 0; }
+};
+
+// Table geometry. Every component is templated on a geometry class:
+// DYNAMIC_GEOMETRY takes the sizes from a PREDICTOR_CONFIG when the
+// predictor is built, STATIC_GEOMETRY fixes them at compile time so the
+// masks fold to constants and the per-table loops unroll. History
+// widths are only needed at construction and always come from the
+// config (STATIC_GEOMETRY checks that they match).
+struct DYNAMIC_GEOMETRY {
+  UINT32 base_table_entry_num;
+  UINT32 tage_table_num;
+  UINT32 tage_index_width;
+  UINT32 tage_tag_width;
+  UINT32 loop_index_width;
+  UINT32 loop_tag_width;
+  UINT32 cf_ctr_num;
+  UINT32 cf_tag_width;
+
+  DYNAMIC_GEOMETRY(const PREDICTOR_CONFIG &config);
+  UINT32 baseTableEntryNum() const { return base_table_entry_num; }
+  UINT32 tageTableNum() const { return tage_table_num; }
+  UINT32 tageIndexWidth() const { return tage_index_width; }
+  UINT32 tageTagWidth() const { return tage_tag_width; }
+  UINT32 loopIndexWidth() const { return loop_index_width; }
+  UINT32 loopTagWidth() const { return loop_tag_width; }
+  UINT32 cfCtrNum() const { return cf_ctr_num; }
+  UINT32 cfTagWidth() const { return cf_tag_width; }
+};
+
+template <UINT32 BaseTableEntryNum, UINT32 TageTableNum,
+          UINT32 TageIndexWidth, UINT32 TageTagWidth,
+          const UINT32 *TageHistoryWidth, UINT32 LoopIndexWidth,
+          UINT32 LoopTagWidth, UINT32 CfCtrNum, UINT32 CfTagWidth>
+struct STATIC_GEOMETRY {
+  STATIC_GEOMETRY(const PREDICTOR_CONFIG &config) {
+    // Only the tuning options of the config apply to a fixed geometry
+    DYNAMIC_GEOMETRY g(config);
+    bool same = g.base_table_entry_num == BaseTableEntryNum &&
+                g.tage_table_num == TageTableNum &&
+                g.tage_index_width == TageIndexWidth &&
+                g.tage_tag_width == TageTagWidth &&
+                g.loop_index_width == LoopIndexWidth &&
+                g.loop_tag_width == LoopTagWidth &&
+                g.cf_ctr_num == CfCtrNum && g.cf_tag_width == CfTagWidth;
+    for (UINT32 i = 0; same && i < TageTableNum; i++) {
+      same = config.tage_history_width[i] == TageHistoryWidth[i];
+    }
+    if (!same) {
+      printf("Table geometry is fixed at compile time in this build\n");
+      exit(-1);
+    }
+  }
+  static constexpr UINT32 baseTableEntryNum() { return BaseTableEntryNum; }
+  static constexpr UINT32 tageTableNum() { return TageTableNum; }
+  static constexpr UINT32 tageIndexWidth() { return TageIndexWidth; }
+  static constexpr UINT32 tageTagWidth() { return TageTagWidth; }
+  static constexpr UINT32 loopIndexWidth() { return LoopIndexWidth; }
+  static constexpr UINT32 loopTagWidth() { return LoopTagWidth; }
+  static constexpr UINT32 cfCtrNum() { return CfCtrNum; }
+  static constexpr UINT32 cfTagWidth() { return CfTagWidth; }
+};
+
+// The default 32KB configuration (make predictor_32kb)
+typedef STATIC_GEOMETRY<BASE_TABLE_ENTRY_NUM, TAGE_TABLE_NUM,
+                        TAGE_TABLE_INDEX_WIDTH, TAGE_TAG_WIDTH,
+                        TAGE_TABLE_HISTORY_WIDTH, LOOP_TABLE_INDEX_WIDTH,
+                        LOOP_TAG_WIDTH, CF_CTR_NUM, CF_TAG_WIDTH>
+    GEOMETRY_32KB;
+
+// Flat binary snapshot of the predictor state (TAGE_SC_L::SaveState):
+// an 8-byte magic and a version, the geometry it was taken with, then
+// each component's scalars and arrays in a fixed order. Every array
+// starts on a PREDICTOR_STATE_ALIGN boundary of the file, so a mapped
+// snapshot can be used in place. Components describe their state once,
+// in checkpoint(), and the same code path saves and restores it.
+#define PREDICTOR_STATE_MAGIC "CBP4STAT"
+#define PREDICTOR_STATE_VERSION 7
+#define PREDICTOR_STATE_ALIGN 64
+
+class PREDICTOR_CHECKPOINT {
+private:
+  FILE *file;
+  const char *file_name;
+  bool saving;
+  UINT64 offset;
+
+  void bytes(void *data, size_t size);
+  void align();
+
+public:
+  PREDICTOR_CHECKPOINT(const char *fileName, bool save);
+  ~PREDICTOR_CHECKPOINT();
+  PREDICTOR_CHECKPOINT(const PREDICTOR_CHECKPOINT &) = delete;
+  PREDICTOR_CHECKPOINT &operator=(const PREDICTOR_CHECKPOINT &) = delete;
+
+  template <class T> void value(T &v) { bytes(&v, sizeof(v)); }
+  template <class T> void array(T *data, size_t n) {
+    align();
+    bytes(data, n * sizeof(T));
+  }
+  // a geometry parameter: saved, or checked against the snapshot
+  void check(UINT32 v, const char *what);
+};
+
+// Global history register of any length, kept as a circular buffer
+// with one bit per byte; bit(0) is the newest outcome. The newest 64
+// bits are also kept packed for hashes that read raw history.
+class GlobalHistory {
+private:
+  std::vector<UINT8> bits;
+  UINT32 ptr;
+  UINT32 mask;
+  UINT64 recent_bits;
+
+public:
+  void init(UINT32 max_length) {
+    UINT32 size = 1;
+    while (size <= max_length) {
+      size <<= 1;
+    }
+    bits.assign(size, 0);
+    mask = size - 1;
+    ptr = 0;
+    recent_bits = 0;
+  }
+
+  bool bit(UINT32 i) const { return bits[(ptr + i) & mask]; }
+  UINT64 recent() const { return recent_bits; }
+
+  void push(bool taken) {
+    ptr = (ptr - 1) & mask;
+    bits[ptr] = taken;
+    recent_bits = (recent_bits << 1) | taken;
+  }
+
+  void checkpoint(PREDICTOR_CHECKPOINT &cp) {
+    cp.check(bits.size(), "history buffer size");
+    cp.value(ptr);
+    cp.value(recent_bits);
+    cp.array(bits.data(), bits.size());
+  }
+};
+
+// Path history: every taken branch, conditional or not, shifts
+// PATH_INSERT_WIDTH bits of its PC and target into the register, so it
+// tells apart paths that reach a branch with the same directions.
+class PathHistory {
+private:
+  UINT32 bits;
+  UINT32 mask;
+
+public:
+  void init(UINT32 width) {
+    bits = 0;
+    mask = (width >= 32) ? ~0u : (1u << width) - 1;
+  }
+
+  UINT32 value() const { return bits; }
+
+  void push(UINT32 PC, UINT32 target) {
+    // PCs are byte aligned on some traces and word aligned on others
+    UINT32 h = PC ^ (PC >> 2) ^ target ^ (target >> 2);
+    bits = ((bits << PATH_INSERT_WIDTH) | (h & bitmask(PATH_INSERT_WIDTH))) &
+           mask;
+  }
+
+  void checkpoint(PREDICTOR_CHECKPOINT &cp) { cp.value(bits); }
+};
+
+// Folded global history: the newest `length` history bits XORed together
+// in chunks of `width` bits (bit i lands on bit i % width). Updated in
+// O(1) per branch from the incoming and the outgoing history bit.
+struct FoldedHistory {
+  UINT32 comp;
+  UINT32 length;
+  UINT32 width;
+  UINT32 outpoint;
+
+  void init(UINT32 length, UINT32 width) {
+    this->comp = 0;
+    this->length = length;
+    this->width = width;
+    this->outpoint = length % width;
+  }
+
+  // newest: bit shifted into the history, oldest: bit length-1 of the
+  // history before the shift, which leaves the window
+  void update(bool newest, bool oldest) {
+    comp = (comp << 1) | newest;
+    comp ^= (UINT32)oldest << outpoint;
+    comp ^= comp >> width;
+    comp &= bitmask(width);
+  }
+};
+
+// Structure for TAGE table entries, packed into 4 bytes. The tag comes
+// first: the SIMD matchers compare the low 16 bits of each entry.
 struct TageEntry {
-  UINT8 pred;
   UINT16 tag;
+  UINT8 pred;
   UINT8 u;
 };
 
+// Compares the entries at index[0..n) against tag[0..n) and returns the
+// hit bitmask. index and tag must be readable up to the next multiple
+// of 8.
+typedef UINT32 (*TageMatchFn)(const TageEntry *arena, const UINT32 *index,
+                              const UINT32 *tag, UINT32 n);
+
+// The same for set-associative tables: index[t] is the first entry of
+// the set on entry, and on return the entry that hit or, on a miss, the
+// one to replace (the lowest u, the lowest way on a tie).
+typedef UINT32 (*TageSetMatchFn)(const TageEntry *arena, UINT32 *index,
+                                 const UINT32 *tag, UINT32 n, UINT32 ways);
+
 // Structure for loop predictor entries
 struct LoopEntry {
   UINT16 tag; // Tag for loop entry
@@ -92,110 +405,347 @@ struct LoopEntry {
 };
 
 // Base predictor class
-class BasePredictor {
+template <class G> class BasePredictor {
 private:
-  UINT8  base_table[BASE_TABLE_ENTRY_NUM]; // Base table for predictions
-  UINT32 base_table_entry_num;
+  G geom;
+  std::vector<UINT8> base_table; // Base table for predictions
   UINT32 base_table_index;
   UINT8 base_counter;
   bool high_conf;
 
 public:
-  BasePredictor();
+  BasePredictor(const G &geometry);
   bool predict(UINT32 PC);
   void update(bool resolveDir);
   bool highConf();
+  UINT64 storageBits();
+  void checkpoint(PREDICTOR_CHECKPOINT &cp);
 };
 
 
 
-// TAGE predictor class
-class TAGE {
+// TAGE predictor class: every tagged table. The entries of all tables
+// live in one cache-line aligned arena, table t occupying entries
+// [t << index width, (t + 1) << index width). match() computes every
+// index and tag first and only then touches the arena, so the loads of
+// all tables are issued together.
+//
+// With tage_ways = 2 or 4 each table is split into sets of that many
+// consecutive entries (same storage, fewer index bits), and a tag may
+// sit in any way of its set. With tage_banked the index-width slices of
+// the arena are banks shared by all tables: for each branch, table t
+// reads bank (start + t) % tables, start depending on the PC, so one
+// lookup touches every bank exactly once, as a single-ported banked
+// hardware layout would.
+template <class G> class TAGE {
 private:
-  TageEntry *tag_table; // Tag table for TAGE
-  UINT128 *ghr;         // Global history register
-  UINT32 tag_table_entry_num;
-  UINT32 tag_history_width;
-  UINT32 tag;
-  UINT32 index;
+  G geom;
+  TageEntry *tag_table;     // Arena holding every table
+  const GlobalHistory *ghr; // Global history register
+  const PathHistory *path;
+  UINT32 tag_table_entry_num; // Entries in the arena
+  UINT32 tag_hash;
+  UINT32 tag_history_width[TAGE_MAX_TABLE_NUM];
+  UINT32 path_width;
+  UINT32 path_mask[TAGE_MAX_TABLE_NUM]; // no more path than history
+  TageMatchFn match_tags;
+  TageSetMatchFn match_sets;
+  UINT32 ways;
+  UINT32 way_shift; // log2(ways)
+  bool banked;
+
+  // Per table state for the branch being predicted
+  UINT32 index[TAGE_MAX_TABLE_NUM]; // Arena index
+  UINT32 tag[TAGE_MAX_TABLE_NUM];
+
+  FoldedHistory index_fold[TAGE_MAX_TABLE_NUM]; // onto the index width
+  FoldedHistory tag_fold[TAGE_MAX_TABLE_NUM][2]; // onto tag width, width - 1
 
 public:
-  TAGE(UINT32 history_width, UINT128 *ghr);
-  bool match(UINT32 PC);
-  bool predict();
-  bool isNewEntry();
-  bool highConf();
-  void updateHit(bool resolveDir);
-  void updateMiss();
-  void updateMissNewEntry(bool resolveDir);
-  void updateU(bool resolveDir, bool predDir);
-  void resetU(UINT8 mask);
-  UINT16 getTag(UINT32 PC); // hash 2
-  UINT32 getTagTableIndex(UINT32 PC); // hash 1 to get tag from table
-  UINT8 getU();
+  TAGE(const G &geometry, const PREDICTOR_CONFIG &config,
+       const GlobalHistory *ghr, const PathHistory *path);
+  ~TAGE();
+  TAGE(const TAGE &) = delete;
+  TAGE &operator=(const TAGE &) = delete;
+  UINT32 match(UINT32 PC); // bit t set if table t hits
+  bool predict(UINT32 t);
+  bool highConf(UINT32 t);
+  void updateHit(UINT32 t, bool resolveDir);
+  void updateMiss(UINT32 t);
+  void updateMissNewEntry(UINT32 t, bool resolveDir);
+  void updateU(UINT32 t, bool resolveDir, bool predDir);
+  void resetU(UINT8 mask, UINT32 from, UINT32 to); // arena entries
+  UINT32 entryNum() { return tag_table_entry_num; }
+  UINT32 pathWidth() { return path_width; }
+  UINT32 getWays() { return ways; }
+  bool isBanked() { return banked; }
+  UINT16 getTag(UINT32 PC, UINT32 t); // hash 2
+  UINT32 getTagTableIndex(UINT32 PC, UINT32 t); // hash 1, set within table t
+  void updateHistory(bool resolveDir); // before the ghr shift
+  UINT8 getU(UINT32 t);
+  UINT32 uZeroMask(); // bit t set if getU(t) == 0
+  UINT64 storageBits();
+  void checkpoint(PREDICTOR_CHECKPOINT &cp);
 };
 
 // Loop predictor class
-class LoopPredictor {
+template <class G> class LoopPredictor {
 private:
-  LoopEntry table[LOOP_TABLE_ENTRY_NUM]; // Loop predictor table
-  
+  G geom;
+  std::vector<LoopEntry> table; // Loop predictor table
+
   UINT32 index;
   UINT16 tag;
   bool use_loop;
   bool pred;
 
 public:
-  LoopPredictor();
+  LoopPredictor(const G &geometry);
   void predict(UINT32 pc);
   void update(bool resolveDir, bool tage_pred);
   void resetEntry(UINT32 idx);
   bool useLoop();
   bool prediction();
+  UINT64 storageBits();
+  void checkpoint(PREDICTOR_CHECKPOINT &cp);
 };
 
 // Corrector filter class
-class CorrectorFilter {
+template <class G> class CorrectorFilter {
 private:
-  UINT8 ctr[CF_CTR_NUM]; // Counter array
-  UINT8 tag_table[CF_CTR_NUM]; // Tag array
+  G geom;
+  std::vector<UINT8> ctr;       // Counter array
+  std::vector<UINT8> tag_table; // Tag array
   UINT32 index;
   UINT32 tag;
+  UINT32 ctr_strong;
+  UINT32 ctr_weak;
 
 public:
-  CorrectorFilter();
+  CorrectorFilter(const G &geometry, UINT32 ctr_strong, UINT32 ctr_weak);
   bool predict(UINT32 pc, bool tage_result, bool highconf);
   void update(bool tage_result, bool resolveDir, bool highconf);
+  UINT64 storageBits();
+  void checkpoint(PREDICTOR_CHECKPOINT &cp);
+};
+
+// Per-PC local histories, newest outcome in bit 0, shared by the local
+// component and the statistical corrector. Each entry is two bytes: the
+// history in the low bits and the local component's 2-bit chooser on
+// top, so one load yields both. The entries sit in a cache-line
+// aligned array, 32 to a line. lookup() remembers its entry and
+// update() shifts the outcome into it, so the table costs one load and
+// one store per branch.
+class LocalHistoryTable {
+private:
+  UINT16 *entry;
+  UINT32 entry_num;
+  UINT32 width;
+  UINT32 slot;    // entry of the last lookup
+  UINT16 current; // its value
+
+public:
+  LocalHistoryTable(const PREDICTOR_CONFIG &config, bool used);
+  ~LocalHistoryTable();
+  LocalHistoryTable(const LocalHistoryTable &) = delete;
+  LocalHistoryTable &operator=(const LocalHistoryTable &) = delete;
+
+  UINT32 lookup(UINT32 PC) {
+    slot = PC & (entry_num - 1);
+    current = entry[slot];
+    return current & bitmask(width);
+  }
+  UINT32 chooser() const { return current >> LOCAL_CHOOSER_SHIFT; }
+
+  void update(bool resolveDir, UINT32 chooser) {
+    entry[slot] = (chooser << LOCAL_CHOOSER_SHIFT) |
+                  (((current << 1) | resolveDir) & bitmask(width));
+  }
+
+  UINT64 storageBits(bool with_chooser);
+  void checkpoint(PREDICTOR_CHECKPOINT &cp);
+};
+
+// Local component: a table of 3-bit counters indexed by the PC and the
+// branch's local history, as the local PHT of a tournament predictor.
+// Sized from the config only, like the statistical corrector.
+class LocalPredictor {
+private:
+  std::vector<UINT8> table;
+  UINT32 index_width;
+  UINT32 index;
+  UINT8 ctr;
+
+public:
+  LocalPredictor(const PREDICTOR_CONFIG &config);
+  bool predict(UINT32 PC, UINT32 local);
+  bool highConf() { return ctr == 0 || ctr == LOCAL_CTR_MAX; }
+  void update(bool resolveDir);
+  UINT64 storageBits();
+  void checkpoint(PREDICTOR_CHECKPOINT &cp);
+};
+
+// Statistical corrector: GEHL-style tables of signed counters indexed by
+// the PC hashed with the global history (one folded history per table),
+// with the branch's local history (LocalHistoryTable), and with the IMLI
+// count (taken backward branches in a row), plus a bias table indexed by
+// the TAGE prediction and confidence. The counters of all tables live in
+// one arena; predict() copies one counter per table into a 16-byte row
+// and sums the row in a single SIMD step. Sized from the config only, it
+// is not part of the static geometries.
+class StatisticalCorrector {
+private:
+  std::vector<signed char> table; // arena, table t at [t << index_width, ...)
+  UINT32 index_width;
+  INT32 ctr_max;
+  UINT32 table_num;
+  UINT32 global_num; // tables 1 .. global_num
+  UINT32 local_num;  // then the local tables, then IMLI
+  bool use_imli;
+  const GlobalHistory *ghr;
+
+  UINT32 global_width[SC_MAX_TABLE_NUM];
+  FoldedHistory global_fold[SC_MAX_TABLE_NUM]; // onto the index width
+  UINT32 local_width[SC_MAX_TABLE_NUM];
+  UINT32 imli;
+
+  INT32 threshold; // train while |sum| is below it
+  INT32 tc;        // adapts the threshold
+
+  // state for the branch being predicted
+  UINT32 index[SC_MAX_TABLE_NUM];
+  alignas(16) signed char row[SC_MAX_TABLE_NUM]; // zero past table_num
+  INT32 sum;
+
+public:
+  StatisticalCorrector(const PREDICTOR_CONFIG &config,
+                       const GlobalHistory *ghr);
+  // local: the branch's LocalHistoryTable history; >= 0: taken
+  INT32 predict(UINT32 PC, bool tage_pred, bool high_conf, UINT32 local);
+  INT32 getThreshold() { return threshold; }
+  UINT32 historyWidth(); // longest global history read
+  void update(UINT32 PC, bool resolveDir, UINT32 branchTarget);
+  void updateHistory(bool resolveDir); // before the ghr shift
+  UINT64 storageBits();
+  void checkpoint(PREDICTOR_CHECKPOINT &cp);
+};
+
+// What the predictor did, behind the MPKI (TAGE_SC_L::PrintCounters).
+// Counting does not change any prediction, and the counters are not
+// part of a snapshot.
+struct PREDICTOR_COUNTERS {
+  UINT64 tage_hits[TAGE_MAX_TABLE_NUM]; // lookups hitting table t
+  // [0] base predictor (no table hit), [1 + t] TAGE table t
+  UINT64 provided[1 + TAGE_MAX_TABLE_NUM];
+  UINT64 provided_wrong[1 + TAGE_MAX_TABLE_NUM];
+  UINT64 loop_used;            // loop predictor gave the final prediction
+  UINT64 loop_overrides;       // ... and it differed from TAGE
+  UINT64 loop_overrides_right;
+  UINT64 cf_overrides;         // CF changed the TAGE prediction
+  UINT64 cf_overrides_right;
+  UINT64 sc_overrides;         // SC changed it and had the final say
+  UINT64 sc_overrides_right;
+  UINT64 local_overrides;      // the local component, likewise
+  UINT64 local_overrides_right;
+  UINT64 alloc_success;        // new TAGE entry after a misprediction
+  UINT64 alloc_failure;        // no free entry, u counters decayed
+  UINT64 u_resets;             // full u-counter aging sweeps
 };
 
 // Main predictor class
-class PREDICTOR {
+template <class G> class TAGE_SC_L {
 private:
-  UINT128 ghr; // Global history register
+  G geom;
+  GlobalHistory ghr; // Global history register
+  PathHistory path;
+  bool use_path;
   UINT32 clock;
+  UINT32 u_reset;
+  UINT32 u_reset_cursor; // next arena entry to age (incremental)
   INT32 first_predictor;
   INT32 second_predictor;
   bool first_prediction;
   bool second_prediction;
 
-  bool tage_prediction;
+  bool tage_prediction; // after the statistical corrector
   bool cf_prediction;
+  bool sc_override;
+  bool local_prediction;
+  bool local_disagrees; // confident, against a weak TAGE prediction
+  bool local_override;
+  UINT32 local_history; // of the branch being predicted
   bool high_conf;
   bool pred_is_new_entry;
+  UINT32 tage_hits; // match() mask of the last lookup
 
   UINT16 use_cf;
+  UINT32 use_cf_threshold;
+  bool use_sc;
+  bool use_local;
+  bool use_local_history; // local or sc
+  UINT32 ghr_width; // longest TAGE history
+
+  // Private xorshift32 stream for the allocation choice, so instances
+  // sharing a process do not perturb each other
+  UINT32 rand_state;
+
+  TAGE<G> tage;          // Tagged TAGE tables
+  BasePredictor<G> bp;   // Base predictor
+  LoopPredictor<G> lp;   // Loop predictor
+  CorrectorFilter<G> cf; // Corrector filter
+  StatisticalCorrector sc;
+  LocalHistoryTable lht;
+  LocalPredictor local;
 
-  std::vector<std::unique_ptr<TAGE>> tage_list; // List of TAGE predictors
-  BasePredictor bp;                             // Base predictor
-  LoopPredictor lp;                             // Loop predictor
-  CorrectorFilter cf;                           // Corrector filter
+  PREDICTOR_COUNTERS counters;
+
+  UINT32 nextRandom() {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+  }
+
+  void Checkpoint(PREDICTOR_CHECKPOINT &cp);
+  void Count(bool resolveDir);
 
 public:
-  PREDICTOR(void);
+  TAGE_SC_L(void);
+  TAGE_SC_L(const PREDICTOR_CONFIG &config);
   bool GetPrediction(UINT32 PC);
   void UpdatePredictor(UINT32 PC, bool resolveDir, bool predDir,
                        UINT32 branchTarget);
-  void TrackOtherInst(UINT32 PC, OpType opType, UINT32 branchTarget);
+
+  // Every non-conditional record comes here, most of them not branches,
+  // so the check is inlined into the simulator loop. Calls, returns,
+  // jumps and indirect branches are all taken.
+  void TrackOtherInst(UINT32 PC, OpType opType, UINT32 branchTarget) {
+    if (use_path && opType >= OPTYPE_CALL_DIRECT) {
+      path.push(PC, branchTarget);
+    }
+  }
+
+  UINT64 GetStorageBits();
+
+  // PROVIDER_* of the last GetPrediction; valid until UpdatePredictor
+  UINT32 GetProvider();
+
+  // PREDICTOR_COUNTERS, in the simulator's "NAME : value" format
+  const PREDICTOR_COUNTERS &GetCounters() { return counters; }
+  void PrintCounters();
+
+  // Everything that carries over from one branch to the next; a
+  // restored predictor predicts exactly as the saved one would have
+  void SaveState(const char *fileName);
+  void LoadState(const char *fileName);
 };
 
+// The simulator's PREDICTOR. Both variants are instantiated in
+// predictor.cc; main.cc picks the fixed one for predictor_32kb.
+#ifdef PREDICTOR_STATIC_32KB
+typedef TAGE_SC_L<GEOMETRY_32KB> PREDICTOR;
+#else
+typedef TAGE_SC_L<DYNAMIC_GEOMETRY> PREDICTOR;
+#endif
+
 #endif
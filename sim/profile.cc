@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cstring>
+#include "profile.h"
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+BRANCH_PROFILE::BRANCH_PROFILE(){
+  table.assign(PROFILE_INIT_SIZE, PROFILE_ENTRY());
+  mask  = PROFILE_INIT_SIZE - 1;
+  shift = 32 - __builtin_ctz(PROFILE_INIT_SIZE);
+  used  = 0;
+
+  memset(provided, 0, sizeof(provided));
+  memset(missed, 0, sizeof(missed));
+}
+
+void BRANCH_PROFILE::Grow(){
+  std::vector<PROFILE_ENTRY> old;
+  old.swap(table);
+
+  table.assign(old.size() * 2, PROFILE_ENTRY());
+  mask  = table.size() - 1;
+  shift--;
+  used  = 0;
+
+  for(const PROFILE_ENTRY &e : old){
+    if(e.exec != 0){
+      *Find(e.PC) = e;
+    }
+  }
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+static void ProviderName(UINT32 provider, char *name){
+  switch(provider){
+  case PROVIDER_BASE: strcpy(name, "BASE"); break;
+  case PROVIDER_LOOP: strcpy(name, "LOOP"); break;
+  case PROVIDER_CF:   strcpy(name, "CF");   break;
+  case PROVIDER_SC:   strcpy(name, "SC");   break;
+  case PROVIDER_LOCAL: strcpy(name, "LOCAL"); break;
+  default: sprintf(name, "TAGE_T%u", provider - PROVIDER_TAGE); break;
+  }
+}
+
+static double Pct(UINT64 part, UINT64 whole){
+  return whole ? 100.0 * part / whole : 0;
+}
+
+void BRANCH_PROFILE::Print(UINT32 topN, UINT64 numMispred){
+  std::vector<PROFILE_ENTRY> branches;
+  for(const PROFILE_ENTRY &e : table){
+    if(e.exec != 0){
+      branches.push_back(e);
+    }
+  }
+
+  printf("%-21s\t : %10zu\n\n", "PROFILE_BRANCHES", branches.size());
+
+  // what each component predicted, and its share of all mispredictions
+  printf("%-10s %14s %14s %9s %9s\n", "PROVIDER", "PREDICTIONS",
+         "MISPREDICTIONS", "MISP_PCT", "SHARE_PCT");
+  for(UINT32 p = 0; p < PROVIDER_NUM; p++){
+    if(provided[p] == 0){
+      continue;
+    }
+    char name[16];
+    ProviderName(p, name);
+    printf("%-10s %14llu %14llu %9.2f %9.2f\n", name, provided[p], missed[p],
+           Pct(missed[p], provided[p]), Pct(missed[p], numMispred));
+  }
+  printf("\n");
+
+  topN = std::min<size_t>(topN, branches.size());
+  std::partial_sort(branches.begin(), branches.begin() + topN, branches.end(),
+                    [](const PROFILE_ENTRY &a, const PROFILE_ENTRY &b){
+                      UINT64 ma = a.Mispredictions();
+                      UINT64 mb = b.Mispredictions();
+                      return ma != mb ? ma > mb : a.exec > b.exec;
+                    });
+
+  // the hardest branches, with who mispredicted them
+  printf("%-5s %-10s %12s %12s %9s %9s %9s %10s %10s %10s %10s %10s %10s\n",
+         "RANK", "PC", "EXECUTIONS", "MISPREDICT", "MISP_PCT", "SHARE_PCT",
+         "CUM_PCT", "BASE", "TAGE", "LOOP", "CF", "SC", "LOCAL");
+  UINT64 cumulative = 0;
+  for(UINT32 i = 0; i < topN; i++){
+    const PROFILE_ENTRY &e = branches[i];
+    UINT64 m = e.Mispredictions();
+    cumulative += m;
+    printf("%-5u 0x%08x %12llu %12llu %9.2f %9.2f %9.2f", i + 1, e.PC, e.exec,
+           m, Pct(m, e.exec), Pct(m, numMispred), Pct(cumulative, numMispred));
+    for(UINT32 c = 0; c < PROFILE_CLASS_NUM; c++){
+      printf(" %10llu", e.miss[c]);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
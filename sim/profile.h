@@ -0,0 +1,105 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <vector>
+#include "utils.h"
+#include "predictor.h"
+
+// Per-branch misprediction profile (predictor -profile N): executions and
+// mispredictions of every conditional branch PC, with the mispredictions
+// split by the kind of component that made the final prediction, plus
+// predictions and mispredictions per component (base, each TAGE table,
+// loop, CF, SC, local). Branches live in an open-addressing table keyed
+// by PC, so recording one costs a hash and usually a single probe.
+
+#define PROFILE_INIT_SIZE (1 << 12) // entries, a power of two
+
+// Per-branch misprediction breakdown
+#define PROFILE_CLASS_BASE 0
+#define PROFILE_CLASS_TAGE 1
+#define PROFILE_CLASS_LOOP 2
+#define PROFILE_CLASS_CF 3
+#define PROFILE_CLASS_SC 4
+#define PROFILE_CLASS_LOCAL 5
+#define PROFILE_CLASS_NUM 6
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+struct PROFILE_ENTRY{
+  UINT32 PC;
+  UINT64 exec; // 0: free slot
+  UINT64 miss[PROFILE_CLASS_NUM];
+
+  UINT64 Mispredictions() const {
+    UINT64 sum = 0;
+    for(UINT32 c = 0; c < PROFILE_CLASS_NUM; c++){
+      sum += miss[c];
+    }
+    return sum;
+  }
+};
+
+class BRANCH_PROFILE{
+ private:
+  std::vector<PROFILE_ENTRY> table;
+  UINT32 mask;
+  UINT32 shift; // 32 - log2(table size), to hash from the high bits
+  UINT32 used;
+
+  UINT64 provided[PROVIDER_NUM];
+  UINT64 missed[PROVIDER_NUM];
+
+  static UINT32 Class(UINT32 provider){
+    switch(provider){
+    case PROVIDER_BASE: return PROFILE_CLASS_BASE;
+    case PROVIDER_LOOP: return PROFILE_CLASS_LOOP;
+    case PROVIDER_CF:   return PROFILE_CLASS_CF;
+    case PROVIDER_SC:   return PROFILE_CLASS_SC;
+    case PROVIDER_LOCAL: return PROFILE_CLASS_LOCAL;
+    default:            return PROFILE_CLASS_TAGE;
+    }
+  }
+
+  PROFILE_ENTRY *Find(UINT32 PC){
+    UINT32 i = (PC * 0x9E3779B1u) >> shift;
+    while(true){
+      PROFILE_ENTRY *e = &table[i];
+      if(e->PC == PC && e->exec != 0){
+        return e;
+      }
+      if(e->exec == 0){
+        // keep the load at most one half
+        if(++used * 2 > table.size()){
+          Grow();
+          return Find(PC);
+        }
+        e->PC = PC;
+        return e;
+      }
+      i = (i + 1) & mask;
+    }
+  }
+
+  void Grow();
+
+ public:
+  BRANCH_PROFILE();
+
+  void Record(UINT32 PC, UINT32 provider, bool mispredicted){
+    provided[provider]++;
+    missed[provider] += mispredicted;
+
+    PROFILE_ENTRY *e = Find(PC);
+    e->exec++;
+    e->miss[Class(provider)] += mispredicted;
+  }
+
+  // the component table, then the topN branches by mispredictions
+  void Print(UINT32 topN, UINT64 numMispred);
+};
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+#endif // _PROFILE_H_
@@ -0,0 +1,312 @@
+// runall: run every trace of a bench_list suite in one process, on a
+// work-stealing pool of threads, and write a single results file with
+// the MPKI of each trace and their AMEAN. Replaces the per-process fan
+// out of scripts/runall.pl.
+
+#include <sys/stat.h>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "utils.h"
+#include "tracer.h"
+#include "predictor.h"
+
+
+// usage: runall [options]
+//   -w <suite>      suite from the bench list (default all)
+//   -b <file>       bench list (default ../scripts/bench_list.pl)
+//   -t <dir>        trace directory (default ../traces/)
+//   -x <suffix>     trace file suffix (default .cbp4.gz)
+//   -j <threads>    worker threads (default: hardware threads)
+//   -o <file>       results file (default: standard output)
+//   -condonly       replay only the conditional branch section
+//   -c <file>       load predictor options from a config file
+//   -s <key=value>  set predictor options, comma separated (after -c)
+//
+// The results file is tab separated: a header line, one line per trace
+// in suite order, and an AMEAN line.
+
+struct RUN_JOB {
+  std::string name;
+  std::string path;
+  bool        isLong;   // LONG suite traces are scheduled first
+  UINT64      fileSize;
+
+  UINT64 numInst;
+  UINT64 numCondBranch;
+  UINT64 numMispred;
+  double seconds;
+};
+
+// One deque per worker. The owner takes jobs from the front, idle
+// workers steal from the back.
+struct WORK_QUEUE {
+  std::mutex         lock;
+  std::deque<UINT32> jobs;
+};
+
+static void usage(char *prog){
+  printf("usage: %s [-w <suite>] [-b <bench_list>] [-t <trace_dir>] "
+         "[-x <suffix>] [-j <threads>] [-o <results>] [-condonly] "
+         "[-c <config>] [-s key=value,...]\n", prog);
+  exit(-1);
+}
+
+// Reads the %SUITES hash of bench_list.pl: each suite is a list of
+// single-quoted trace names and/or references to other suites
+static std::map<std::string, std::vector<std::string>>
+LoadBenchList(const char *fileName){
+  std::ifstream in(fileName);
+  if (!in) {
+    printf("Unable to open the bench list %s. Dying\n", fileName);
+    exit(-1);
+  }
+  std::stringstream text;
+  text << in.rdbuf();
+  std::string perl = text.str();
+
+  std::map<std::string, std::vector<std::string>> suites;
+  std::regex assign("\\$SUITES\\{'(\\w+)'\\}\\s*=([^;]*);");
+  std::regex item("\\$SUITES\\{'(\\w+)'\\}|'([^']*)'");
+
+  for (std::sregex_iterator a(perl.begin(), perl.end(), assign), end;
+       a != end; ++a) {
+    std::vector<std::string> &list = suites[(*a)[1]];
+    std::string rhs = (*a)[2];
+
+    for (std::sregex_iterator i(rhs.begin(), rhs.end(), item); i != end; ++i) {
+      if ((*i)[1].matched) {
+        const std::vector<std::string> &ref = suites[(*i)[1]];
+        list.insert(list.end(), ref.begin(), ref.end());
+      }
+      else {
+        std::istringstream names((*i)[2]);
+        std::string name;
+        while (names >> name) {
+          list.push_back(name);
+        }
+      }
+    }
+  }
+  return suites;
+}
+
+static void RunJob(RUN_JOB &job, const PREDICTOR_CONFIG &config,
+                   bool condOnly){
+  auto start = std::chrono::steady_clock::now();
+
+  CBP_TRACER *tracer = new CBP_TRACER((char *)job.path.c_str(), condOnly);
+  if (tracer->IsCondOnly() && config.needsOtherInst()) {
+    printf("%s: path history needs the non-conditional branches, which a "
+           "filtered replay drops. Dying\n", job.path.c_str());
+    exit(-1);
+  }
+  PREDICTOR  *brpred = new PREDICTOR(config);
+  CBP_TRACE_RECORD trace;
+  UINT64 numMispred = 0;
+
+  tracer->SetHeartBeat(false);
+
+  while (tracer->GetNextRecord(&trace)) {
+    if (trace.opType == OPTYPE_BRANCH_COND) {
+      bool predDir = brpred->GetPrediction(trace.PC);
+      brpred->UpdatePredictor(trace.PC, trace.branchTaken, predDir,
+                              trace.branchTarget);
+      if (predDir != trace.branchTaken) {
+        numMispred++;
+      }
+    }
+    else {
+      brpred->TrackOtherInst(trace.PC, trace.opType, trace.branchTarget);
+    }
+  }
+
+  job.numInst = tracer->GetNumInst();
+  job.numCondBranch = tracer->GetNumCondBranch();
+  job.numMispred = numMispred;
+
+  delete brpred;
+  delete tracer;
+
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+  job.seconds = d.count();
+}
+
+static void Worker(UINT32 self, std::vector<WORK_QUEUE> &queues,
+                   std::vector<RUN_JOB> &jobs, const PREDICTOR_CONFIG &config,
+                   bool condOnly, std::mutex &outputLock){
+  UINT32 numQueues = queues.size();
+
+  while (true) {
+    bool found = false;
+    UINT32 j = 0;
+
+    // own queue first, then steal from the others
+    for (UINT32 k = 0; k < numQueues && !found; k++) {
+      WORK_QUEUE &q = queues[(self + k) % numQueues];
+      std::lock_guard<std::mutex> guard(q.lock);
+      if (!q.jobs.empty()) {
+        if (k == 0) {
+          j = q.jobs.front();
+          q.jobs.pop_front();
+        }
+        else {
+          j = q.jobs.back();
+          q.jobs.pop_back();
+        }
+        found = true;
+      }
+    }
+
+    // nothing is ever queued once the workers start
+    if (!found) {
+      return;
+    }
+
+    RunJob(jobs[j], config, condOnly);
+
+    std::lock_guard<std::mutex> guard(outputLock);
+    fprintf(stderr, "%-20s %10.3f MPKI %8.1fs\n", jobs[j].name.c_str(),
+            1000.0 * (double)jobs[j].numMispred / (double)jobs[j].numInst,
+            jobs[j].seconds);
+  }
+}
+
+int main(int argc, char* argv[]){
+
+  const char *suite = "all";
+  const char *benchList = "../scripts/bench_list.pl";
+  std::string traceDir = "../traces/";
+  std::string suffix = ".cbp4.gz";
+  UINT32 numThreads = std::thread::hardware_concurrency();
+  const char *outName = NULL;
+  bool condOnly = false;
+  PREDICTOR_CONFIG config;
+
+  for (int argi = 1; argi < argc; argi++) {
+    bool hasValue = argi + 1 < argc;
+    if (strcmp(argv[argi], "-condonly") == 0) {
+      condOnly = true;
+    }
+    else if (strcmp(argv[argi], "-w") == 0 && hasValue) {
+      suite = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "-b") == 0 && hasValue) {
+      benchList = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "-t") == 0 && hasValue) {
+      traceDir = argv[++argi];
+      if (traceDir.back() != '/') {
+        traceDir += '/';
+      }
+    }
+    else if (strcmp(argv[argi], "-x") == 0 && hasValue) {
+      suffix = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "-j") == 0 && hasValue) {
+      numThreads = strtoul(argv[++argi], NULL, 0);
+    }
+    else if (strcmp(argv[argi], "-o") == 0 && hasValue) {
+      outName = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "-c") == 0 && hasValue) {
+      if (!config.load(argv[++argi])) exit(-1);
+    }
+    else if (strcmp(argv[argi], "-s") == 0 && hasValue) {
+      if (!config.parse(argv[++argi])) exit(-1);
+    }
+    else {
+      usage(argv[0]);
+    }
+  }
+
+  std::map<std::string, std::vector<std::string>> suites =
+      LoadBenchList(benchList);
+  if (suites[suite].empty()) {
+    printf("No benchmark set '%s' defined in %s\n", suite, benchList);
+    exit(-1);
+  }
+
+  // The tracer dies on a missing file, check them all before starting
+  std::vector<RUN_JOB> jobs;
+  const std::vector<std::string> &longSuite = suites["LONG"];
+  for (const std::string &name : suites[suite]) {
+    RUN_JOB job = {};
+    struct stat st;
+    job.name = name;
+    job.path = traceDir + name + suffix;
+    if (stat(job.path.c_str(), &st) != 0) {
+      printf("Unable to open the trace file %s. Dying\n", job.path.c_str());
+      exit(-1);
+    }
+    job.fileSize = st.st_size;
+    job.isLong = std::find(longSuite.begin(), longSuite.end(), name) !=
+                 longSuite.end();
+    jobs.push_back(job);
+  }
+
+  // LONG traces first, then by size, dealt round robin to the workers
+  std::vector<UINT32> order(jobs.size());
+  for (UINT32 j = 0; j < jobs.size(); j++) {
+    order[j] = j;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](UINT32 a, UINT32 b) {
+    if (jobs[a].isLong != jobs[b].isLong) {
+      return jobs[a].isLong;
+    }
+    return jobs[a].fileSize > jobs[b].fileSize;
+  });
+
+  numThreads = std::max(1u, std::min<UINT32>(numThreads, jobs.size()));
+  std::vector<WORK_QUEUE> queues(numThreads);
+  for (UINT32 k = 0; k < order.size(); k++) {
+    queues[k % numThreads].jobs.push_back(order[k]);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::mutex outputLock;
+  std::vector<std::thread> workers;
+  for (UINT32 t = 0; t < numThreads; t++) {
+    workers.emplace_back(Worker, t, std::ref(queues), std::ref(jobs),
+                         std::cref(config), condOnly, std::ref(outputLock));
+  }
+  for (std::thread &w : workers) {
+    w.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  ///////////////////////////////////////////
+  //print_stats
+  ///////////////////////////////////////////
+
+  FILE *out = stdout;
+  if (outName && (out = fopen(outName, "w")) == NULL) {
+    printf("Unable to open the results file %s. Dying\n", outName);
+    exit(-1);
+  }
+
+  fprintf(out, "TRACE\tNUM_INSTRUCTIONS\tNUM_CONDITIONAL_BR\t"
+               "NUM_MISPREDICTIONS\tMISPRED_PER_1K_INST\tSECONDS\n");
+  double sumMpki = 0;
+  for (const RUN_JOB &job : jobs) {
+    double mpki = 1000.0 * (double)job.numMispred / (double)job.numInst;
+    sumMpki += mpki;
+    fprintf(out, "%s\t%llu\t%llu\t%llu\t%.3f\t%.2f\n", job.name.c_str(),
+            job.numInst, job.numCondBranch, job.numMispred, mpki, job.seconds);
+  }
+  fprintf(out, "AMEAN\t\t\t\t%.3f\t%.2f\n", sumMpki / jobs.size(),
+          elapsed.count());
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
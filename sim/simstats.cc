@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "simstats.h"
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+static const struct {
+  UINT64      config;
+  const char *name;
+} hwEvents[SIM_STATS_HW_NUM] = {
+  { PERF_COUNT_HW_CPU_CYCLES,    "HW_CYCLES"        },
+  { PERF_COUNT_HW_INSTRUCTIONS,  "HW_INSTRUCTIONS"  },
+  { PERF_COUNT_HW_CACHE_MISSES,  "HW_CACHE_MISSES"  },
+  { PERF_COUNT_HW_BRANCH_MISSES, "HW_BRANCH_MISSES" },
+};
+
+static int OpenCounter(UINT64 config){
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = PERF_TYPE_HARDWARE;
+  attr.config         = config;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.inherit        = 1; // count the -pipeline threads too
+
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+SIM_STATS::SIM_STATS(){
+  startNs     = 0;
+  elapsedNs   = 0;
+  branchCount = 0;
+  numSamples  = 0;
+  predictNs   = 0;
+  updateNs    = 0;
+  timerStart  = 0;
+  timerMid    = 0;
+
+  // every sampled interval includes one clock read
+  const UINT32 reads = 1000;
+  UINT64 first = Now();
+  for(UINT32 i = 0; i < reads; i++){
+    Now();
+  }
+  timerOverheadNs = (double)(Now() - first) / (reads + 1);
+
+  for(UINT32 i = 0; i < SIM_STATS_HW_NUM; i++){
+    hwFd[i]    = OpenCounter(hwEvents[i].config);
+    hwCount[i] = 0;
+  }
+}
+
+SIM_STATS::~SIM_STATS(){
+  for(UINT32 i = 0; i < SIM_STATS_HW_NUM; i++){
+    if(hwFd[i] >= 0){
+      close(hwFd[i]);
+    }
+  }
+}
+
+void SIM_STATS::Start(){
+  for(UINT32 i = 0; i < SIM_STATS_HW_NUM; i++){
+    if(hwFd[i] >= 0){
+      ioctl(hwFd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(hwFd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  startNs = Now();
+}
+
+void SIM_STATS::Stop(){
+  elapsedNs = Now() - startNs;
+  for(UINT32 i = 0; i < SIM_STATS_HW_NUM; i++){
+    if(hwFd[i] >= 0){
+      ioctl(hwFd[i], PERF_EVENT_IOC_DISABLE, 0);
+      if(read(hwFd[i], &hwCount[i], sizeof(hwCount[i])) != sizeof(hwCount[i])){
+        close(hwFd[i]);
+        hwFd[i] = -1;
+      }
+    }
+  }
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+void SIM_STATS::Print(UINT64 numInst, UINT64 numCondBranch){
+  double seconds = elapsedNs / 1e9;
+  double nsPerPrediction = 0;
+  double nsPerUpdate = 0;
+
+  if(numSamples > 0){
+    nsPerPrediction = std::max(0.0, (double)predictNs / numSamples - timerOverheadNs);
+    nsPerUpdate     = std::max(0.0, (double)updateNs / numSamples - timerOverheadNs);
+  }
+
+  // time in the predictor, extrapolated from the samples; the rest of
+  // the run went to reading and decoding the trace
+  double predictPct = 0;
+  if(elapsedNs > 0){
+    predictPct = std::min(100.0, 100.0 * (nsPerPrediction + nsPerUpdate) *
+                                 numCondBranch / elapsedNs);
+  }
+
+  printf("%-21s\t : %10.3f\n",  "SIM_SECONDS",        seconds);
+  printf("%-21s\t : %10.0f\n",  "RECORDS_PER_SEC",    seconds > 0 ? numInst / seconds : 0);
+  printf("%-21s\t : %10.0f\n",  "BRANCHES_PER_SEC",   seconds > 0 ? numCondBranch / seconds : 0);
+  printf("%-21s\t : %10.1f\n",  "NS_PER_PREDICTION",  nsPerPrediction);
+  printf("%-21s\t : %10.1f\n",  "NS_PER_UPDATE",      nsPerUpdate);
+  printf("%-21s\t : %10.1f\n",  "PREDICT_TIME_PCT",   predictPct);
+  printf("%-21s\t : %10.1f\n",  "TRACE_IO_TIME_PCT",  100.0 - predictPct);
+
+  for(UINT32 i = 0; i < SIM_STATS_HW_NUM; i++){
+    if(hwFd[i] >= 0){
+      printf("%-21s\t : %10llu\n", hwEvents[i].name, hwCount[i]);
+    }
+    else{
+      printf("%-21s\t : %10s\n", hwEvents[i].name, "n/a");
+    }
+  }
+  printf("\n");
+}
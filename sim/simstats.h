@@ -0,0 +1,71 @@
+#ifndef _SIMSTATS_H_
+#define _SIMSTATS_H_
+
+#include <time.h>
+#include "utils.h"
+
+// Simulator instrumentation (predictor -stats): wall time of the run,
+// sampled cost of GetPrediction/UpdatePredictor, the split between the
+// predictor and everything else (trace I/O and decoding), and hardware
+// counters from perf_event_open when the kernel allows it.
+
+// One branch in SIM_STATS_SAMPLE_PERIOD is timed; a power of two
+#define SIM_STATS_SAMPLE_PERIOD 64
+
+#define SIM_STATS_HW_NUM 4
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+class SIM_STATS{
+ private:
+  UINT64 startNs;
+  UINT64 elapsedNs;
+
+  // sampled branches
+  UINT64 branchCount;
+  UINT64 numSamples;
+  UINT64 predictNs;
+  UINT64 updateNs;
+  UINT64 timerStart;
+  UINT64 timerMid;
+  double timerOverheadNs; // cost of one Now() call, taken off each sample
+
+  // perf_event_open file descriptors, -1 if unavailable
+  int    hwFd[SIM_STATS_HW_NUM];
+  UINT64 hwCount[SIM_STATS_HW_NUM];
+
+  static UINT64 Now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+
+ public:
+  SIM_STATS();
+  ~SIM_STATS();
+
+  void Start(); // before the first record
+  void Stop();  // after the last one
+
+  // true for the branches to time, which are then bracketed by
+  // StartTimer(), StopPrediction() and StopUpdate()
+  bool SampleBranch(){
+    return (++branchCount & (SIM_STATS_SAMPLE_PERIOD - 1)) == 0;
+  }
+  void StartTimer(){ timerStart = Now(); }
+  void StopPrediction(){ timerMid = Now(); }
+  void StopUpdate(){
+    UINT64 end = Now();
+    predictNs += timerMid - timerStart;
+    updateNs  += end - timerMid;
+    numSamples++;
+  }
+
+  void Print(UINT64 numInst, UINT64 numCondBranch);
+};
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+#endif // _SIMSTATS_H_
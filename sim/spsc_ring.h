@@ -0,0 +1,91 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <atomic>
+#include <thread>
+#include "utils.h"
+
+// Failed attempts before a blocked side gives up its time slice
+#define SPSC_SPIN_LIMIT 64
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Bounded lock-free ring between exactly one producer thread and one
+// consumer thread; Capacity must be a power of two. Each side owns its
+// index on its own cache line and keeps a cached copy of the other
+// side's index, so the shared line is only read when the ring looks full
+// (producer) or empty (consumer).
+template <class T, UINT32 Capacity>
+class SPSC_RING{
+  static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                "SPSC_RING capacity must be a power of two");
+
+ private:
+  // consumer side
+  alignas(64) std::atomic<UINT32> head; // next slot to read
+  UINT32 cachedTail;
+
+  // producer side
+  alignas(64) std::atomic<UINT32> tail; // next slot to write
+  UINT32 cachedHead;
+
+  alignas(64) T slots[Capacity];
+
+  static void Wait(UINT32 *spins){
+    if(++*spins >= SPSC_SPIN_LIMIT){
+      std::this_thread::yield();
+    }
+  }
+
+ public:
+  SPSC_RING() : head(0), cachedTail(0), tail(0), cachedHead(0) {}
+
+  bool TryPush(const T &value){
+    UINT32 t = tail.load(std::memory_order_relaxed);
+    if(t - cachedHead == Capacity){
+      cachedHead = head.load(std::memory_order_acquire);
+      if(t - cachedHead == Capacity){
+        return false;
+      }
+    }
+    slots[t & (Capacity - 1)] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T *value){
+    UINT32 h = head.load(std::memory_order_relaxed);
+    if(h == cachedTail){
+      cachedTail = tail.load(std::memory_order_acquire);
+      if(h == cachedTail){
+        return false;
+      }
+    }
+    *value = slots[h & (Capacity - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // blocking versions: spin, then yield
+  void Push(const T &value){
+    UINT32 spins = 0;
+    while(!TryPush(value)){
+      Wait(&spins);
+    }
+  }
+
+  T Pop(){
+    T value;
+    UINT32 spins = 0;
+    while(!TryPop(&value)){
+      Wait(&spins);
+    }
+    return value;
+  }
+};
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+#endif // _SPSC_RING_H_
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cstring>
+#include "synthgen.h"
+
+// Code layout: kernels of one kind share a 256MB region; the call site
+// that dispatches them sits below all regions
+#define SYNTH_DISPATCH_PC  0x00400000
+#define SYNTH_REGION_SIZE  0x10000000
+#define SYNTH_SLOT_ALIGN   64
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+static UINT64 SplitMix(UINT64 x){
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+static bool ParseNumber(const char *value, UINT64 min, UINT64 max, UINT64 *out){
+  char *end;
+  unsigned long long v = strtoull(value, &end, 0);
+  if(end == value || *end != '\0' || v < min || v > max){
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+static bool ParseNumber(const char *value, UINT32 min, UINT32 max, UINT32 *out){
+  UINT64 v;
+  if(!ParseNumber(value, (UINT64)min, (UINT64)max, &v)){
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+SYNTH_GEN::SYNTH_GEN(const char *spec){
+  numRecords = 10000000;
+  seed       = 1;
+  std::fill(weight, weight + SYNTH_KIND_NUM, 1);
+  footprint  = 1024;
+  depth      = 2;
+  tripMax    = 16;
+  distances  = {5, 16, 37, 91}; // the default TAGE history widths
+  biasPct    = 90;
+  ops        = 4;
+
+  // "key=value,key=value,..."
+  std::string list(spec);
+  size_t pos = 0;
+  while(pos < list.size()){
+    size_t end = list.find(',', pos);
+    if(end == std::string::npos){
+      end = list.size();
+    }
+    std::string item = list.substr(pos, end - pos);
+    size_t eq = item.find('=');
+    if(eq == std::string::npos ||
+       !Set(item.substr(0, eq).c_str(), item.substr(eq + 1).c_str())){
+      printf("Invalid synthetic trace option '%s'. Dying\n", item.c_str());
+      exit(-1);
+    }
+    pos = end + 1;
+  }
+
+  if(weight[0] + weight[1] + weight[2] + weight[3] == 0){
+    printf("Synthetic trace has no kernel kind with a nonzero weight. Dying\n");
+    exit(-1);
+  }
+
+  // branches per static kernel, each after its ops, plus the return
+  UINT32 branches[SYNTH_KIND_NUM] = {
+    depth, *std::max_element(distances.begin(), distances.end()) + 1, 1, 1
+  };
+  for(UINT32 k = 0; k < SYNTH_KIND_NUM; k++){
+    UINT32 bytes = (branches[k] * (ops + 1) + 1) * 4;
+    slotSize[k] = (bytes + SYNTH_SLOT_ALIGN - 1) & ~(SYNTH_SLOT_ALIGN - 1);
+    if((UINT64)slotSize[k] * footprint > SYNTH_REGION_SIZE){
+      printf("Synthetic trace footprint %u does not fit the code region. Dying\n",
+             footprint);
+      exit(-1);
+    }
+  }
+
+  rngState    = SplitMix(seed) | 1;
+  emitted     = 0;
+  inKernel    = false;
+  pendingHead = 0;
+}
+
+bool SYNTH_GEN::Set(const char *key, const char *value){
+  static const char *kinds[SYNTH_KIND_NUM] = {"loop", "corr", "bias", "random"};
+  for(UINT32 k = 0; k < SYNTH_KIND_NUM; k++){
+    if(!strcmp(key, kinds[k])){
+      return ParseNumber(value, 0u, 1000000u, &weight[k]);
+    }
+  }
+
+  if(!strcmp(key, "records"))   return ParseNumber(value, 1ull, ~0ull, &numRecords);
+  if(!strcmp(key, "seed"))      return ParseNumber(value, 0ull, ~0ull, &seed);
+  if(!strcmp(key, "footprint")) return ParseNumber(value, 1u, 1u << 24, &footprint);
+  if(!strcmp(key, "depth"))     return ParseNumber(value, 1u, (UINT32)SYNTH_MAX_DEPTH, &depth);
+  if(!strcmp(key, "trip"))      return ParseNumber(value, 2u, 1u << 16, &tripMax);
+  if(!strcmp(key, "bias_pct"))  return ParseNumber(value, 0u, 100u, &biasPct);
+  if(!strcmp(key, "ops"))       return ParseNumber(value, 0u, 64u, &ops);
+
+  if(!strcmp(key, "distance")){
+    // colon separated, e.g. distance=5:16:37:91
+    distances.clear();
+    std::string list(value);
+    size_t pos = 0;
+    while(pos <= list.size()){
+      size_t end = std::min(list.find(':', pos), list.size());
+      UINT32 d;
+      if(!ParseNumber(list.substr(pos, end - pos).c_str(), 1u,
+                      (UINT32)SYNTH_MAX_DISTANCE, &d)){
+        return false;
+      }
+      distances.push_back(d);
+      pos = end + 1;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// xorshift64*, for the dynamic choices
+UINT64 SYNTH_GEN::NextRandom(){
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+  return rngState * 0x2545F4914F6CDD1Dull;
+}
+
+// fixed properties of a static kernel (trip counts, bias direction)
+UINT32 SYNTH_GEN::KernelRandom(UINT32 kind, UINT32 kernel, UINT32 salt){
+  return SplitMix(seed ^ SplitMix(((UINT64)kind << 48) ^ ((UINT64)salt << 32) ^ kernel)) >> 32;
+}
+
+UINT32 SYNTH_GEN::KernelPC(UINT32 kind, UINT32 kernel){
+  return (kind + 1) * SYNTH_REGION_SIZE + kernel * slotSize[kind];
+}
+
+// the j-th conditional branch of a kernel, after its ops
+UINT32 SYNTH_GEN::BranchPC(UINT32 kernelPC, UINT32 j){
+  return kernelPC + (j * (ops + 1) + ops) * 4;
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+void SYNTH_GEN::Emit(UINT32 PC, OpType opType, bool taken, UINT32 target){
+  CBP_TRACE_RECORD rec;
+  rec.PC           = PC;
+  rec.opType       = opType;
+  rec.branchTaken  = taken;
+  rec.branchTarget = target;
+  pending.push_back(rec);
+}
+
+void SYNTH_GEN::EmitBranch(UINT32 PC, bool taken, UINT32 target){
+  static const OpType opTypes[3] = {OPTYPE_LOAD, OPTYPE_OP, OPTYPE_STORE};
+  for(UINT32 i = 0; i < ops; i++){
+    Emit(PC - 4 * (ops - i), opTypes[i % 3], false, 0);
+  }
+  Emit(PC, OPTYPE_BRANCH_COND, taken, target);
+}
+
+// the return that ends a kernel after its j branch slots
+void SYNTH_GEN::EmitReturn(UINT32 j){
+  Emit(kernelPC + j * (ops + 1) * 4, OPTYPE_RET, true, SYNTH_DISPATCH_PC + 4);
+  inKernel = false;
+}
+
+// the call, and the whole kernel when it is a single branch
+void SYNTH_GEN::StartKernel(){
+  UINT32 total = weight[0] + weight[1] + weight[2] + weight[3];
+  UINT32 r = NextRandom() % total;
+  UINT32 kind = 0;
+  while(r >= weight[kind]){
+    r -= weight[kind++];
+  }
+
+  kernelKind  = kind;
+  kernelIndex = NextRandom() % footprint;
+  kernelPC    = KernelPC(kind, kernelIndex);
+  inKernel    = true;
+  UINT32 PC = kernelPC;
+
+  Emit(SYNTH_DISPATCH_PC, OPTYPE_CALL_DIRECT, true, PC);
+
+  switch(kind){
+  case SYNTH_KIND_LOOP:
+    for(UINT32 level = 0; level < depth; level++){
+      loopTrip[level] =
+        KernelRandom(kind, kernelIndex, level) % (tripMax - 1) + 2;
+      loopIter[level] = 0;
+    }
+    break;
+
+  case SYNTH_KIND_CORR:
+    corrSource = NextRandom() & 1;
+    EmitBranch(BranchPC(PC, 0), corrSource, BranchPC(PC, 1));
+    corrSlot = 1;
+    break;
+
+  case SYNTH_KIND_BIAS: {
+    bool taken = (NextRandom() % 100) < biasPct;
+    taken ^= KernelRandom(kind, kernelIndex, 0) & 1;
+    EmitBranch(BranchPC(PC, 0), taken, BranchPC(PC, 1));
+    EmitReturn(1);
+    break;
+  }
+
+  default:
+    EmitBranch(BranchPC(PC, 0), NextRandom() & 1, BranchPC(PC, 1));
+    EmitReturn(1);
+    break;
+  }
+}
+
+// One iteration of the innermost loop, then the branch of every outer
+// loop whose inner loop it completed. Level 0 is the outermost loop;
+// inner loops sit at lower addresses.
+void SYNTH_GEN::EmitLoopStep(){
+  for(UINT32 level = depth; level-- > 0;){
+    bool again = ++loopIter[level] < loopTrip[level];
+    EmitBranch(BranchPC(kernelPC, depth - 1 - level), again, kernelPC);
+    if(again){
+      return;
+    }
+    loopIter[level] = 0;
+  }
+  EmitReturn(depth);
+}
+
+// the next always-taken branch, or the one repeating the first
+void SYNTH_GEN::EmitCorrStep(){
+  UINT32 distance = distances[kernelIndex % distances.size()];
+  UINT32 j = corrSlot++;
+  if(j < distance){
+    EmitBranch(BranchPC(kernelPC, j), true, BranchPC(kernelPC, j + 1));
+    return;
+  }
+  EmitBranch(BranchPC(kernelPC, j), corrSource ^ (kernelIndex & 1),
+             BranchPC(kernelPC, j + 1));
+  EmitReturn(j + 1);
+}
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+bool SYNTH_GEN::GetNextRecord(CBP_TRACE_RECORD *rec){
+  if(emitted == numRecords){
+    return FAILURE;
+  }
+
+  if(pendingHead == pending.size()){
+    pending.clear();
+    pendingHead = 0;
+    if(!inKernel){
+      StartKernel();
+    }
+    else if(kernelKind == SYNTH_KIND_LOOP){
+      EmitLoopStep();
+    }
+    else{
+      EmitCorrStep();
+    }
+  }
+
+  *rec = pending[pendingHead++];
+  emitted++;
+  return SUCCESS;
+}
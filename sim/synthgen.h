@@ -0,0 +1,92 @@
+#ifndef _SYNTHGEN_H_
+#define _SYNTHGEN_H_
+
+#include <vector>
+#include "utils.h"
+#include "tracer.h"
+
+// Synthetic trace generator, read through CBP_TRACER as a pseudo trace
+// named "synth:<key=value,...>" (e.g. synth:records=50000000,seed=7).
+// The program it models calls one kernel after another; each kernel is
+// a static branch group of one kind, picked by weight:
+//   loop    a loop nest of <depth> levels, fixed trip counts per nest
+//           (2..<trip>), for the loop predictor
+//   corr    a random branch, <distance>-1 always-taken branches, then a
+//           branch repeating (or inverting) the first one, so it is only
+//           predictable with at least <distance> bits of history
+//   bias    taken (or not taken) <bias_pct> percent of the time
+//   random  taken half of the time
+// Every kind has <footprint> static kernels, picked uniformly, so a
+// large footprint stresses aliasing. Each conditional branch follows
+// <ops> non-branch records, and each kernel is bracketed by a call and
+// a return. The same spec always yields the same records. Kernels are
+// generated a branch group at a time (one loop step, one corr branch),
+// so memory does not grow with trip^depth or the distance.
+
+#define SYNTH_KIND_LOOP   0
+#define SYNTH_KIND_CORR   1
+#define SYNTH_KIND_BIAS   2
+#define SYNTH_KIND_RANDOM 3
+#define SYNTH_KIND_NUM    4
+
+#define SYNTH_MAX_DEPTH    4
+#define SYNTH_MAX_DISTANCE 4096
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+class SYNTH_GEN{
+ private:
+  // options
+  UINT64 numRecords;
+  UINT64 seed;
+  UINT32 weight[SYNTH_KIND_NUM];
+  UINT32 footprint;
+  UINT32 depth;
+  UINT32 tripMax;
+  std::vector<UINT32> distances;
+  UINT32 biasPct;
+  UINT32 ops;
+
+  UINT64 rngState;
+  UINT64 emitted;        // records handed out so far
+  UINT32 slotSize[SYNTH_KIND_NUM]; // bytes of code per static kernel
+
+  // the kernel in progress: a loop nest keeps one counter per level,
+  // a corr kernel its next branch slot
+  bool   inKernel;
+  UINT32 kernelKind;
+  UINT32 kernelIndex;
+  UINT32 kernelPC;
+  UINT32 loopTrip[SYNTH_MAX_DEPTH];
+  UINT32 loopIter[SYNTH_MAX_DEPTH];
+  UINT32 corrSlot;
+  bool   corrSource;
+
+  // records of the current branch group, handed out one at a time
+  std::vector<CBP_TRACE_RECORD> pending;
+  UINT32 pendingHead;
+
+  bool   Set(const char *key, const char *value);
+  UINT64 NextRandom();
+  UINT32 KernelRandom(UINT32 kind, UINT32 kernel, UINT32 salt);
+  UINT32 KernelPC(UINT32 kind, UINT32 kernel);
+  UINT32 BranchPC(UINT32 kernelPC, UINT32 j);
+
+  void   Emit(UINT32 PC, OpType opType, bool taken, UINT32 target);
+  void   EmitBranch(UINT32 PC, bool taken, UINT32 target);
+  void   EmitReturn(UINT32 j);
+  void   StartKernel();
+  void   EmitLoopStep();
+  void   EmitCorrStep();
+
+ public:
+  SYNTH_GEN(const char *spec);
+
+  bool   GetNextRecord(CBP_TRACE_RECORD *rec);
+};
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+#endif // _SYNTHGEN_H_
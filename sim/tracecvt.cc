@@ -0,0 +1,147 @@
+// tracecvt: one-time conversion of a .cbp4.gz trace into the native
+// format read by CBP_TRACER (see CBP_NATIVE_HEADER in tracer.h).
+
+#include <cstring>
+#include <vector>
+#include "utils.h"
+#include "tracer.h"
+
+
+// usage: tracecvt [-c|-f] <trace.cbp4.gz> <out.cbp4bin>
+//   -c   also write the conditional-branch-only section
+//   -f   write only the conditional-branch section (filtered trace);
+//        predictor replays it without seeing any other record
+
+#define TRACECVT_IO_BUFFER_SIZE (1 << 22)
+
+static void WriteOrDie(const void *buf, size_t size, FILE *out){
+  if (size && fwrite(buf, size, 1, out) != 1) {
+    printf("Write to the native trace failed. Dying\n");
+    exit(-1);
+  }
+}
+
+// Pad the output up to the next section boundary and return its offset.
+static UINT64 AlignOutput(FILE *out){
+  static const char zeros[TRACE_NATIVE_ALIGN] = {0};
+  UINT64 pos = ftello(out);
+  UINT64 aligned = (pos + TRACE_NATIVE_ALIGN - 1) / TRACE_NATIVE_ALIGN * TRACE_NATIVE_ALIGN;
+  WriteOrDie(zeros, aligned - pos, out);
+  return aligned;
+}
+
+int main(int argc, char* argv[]){
+
+  bool withCond = false;
+  bool withFull = true;
+  int  argi = 1;
+
+  if (argi < argc && strcmp(argv[argi], "-c") == 0) {
+    withCond = true;
+    argi++;
+  }
+  else if (argi < argc && strcmp(argv[argi], "-f") == 0) {
+    withCond = true;
+    withFull = false;
+    argi++;
+  }
+
+  if (argc - argi != 2) {
+    printf("usage: %s [-c|-f] <trace.cbp4.gz> <out.cbp4bin>\n", argv[0]);
+    exit(-1);
+  }
+
+  CBP_TRACER *tracer = new CBP_TRACER(argv[argi]);
+  CBP_TRACE_RECORD *trace = new CBP_TRACE_RECORD();
+
+  if (tracer->IsCondOnly() && withFull) {
+    printf("%s is a filtered trace, only -f can be written from it. Dying\n", argv[argi]);
+    exit(-1);
+  }
+
+  FILE *out = fopen(argv[argi+1], "wb");
+  if (out == NULL) {
+    printf("Unable to create %s. Dying\n", argv[argi+1]);
+    exit(-1);
+  }
+  setvbuf(out, NULL, _IOFBF, TRACECVT_IO_BUFFER_SIZE);
+
+  // conditional branches are spooled to a temp file and appended once
+  // the size of the full section is known
+  FILE *condFile = NULL;
+  std::vector<unsigned char> condTaken;
+  if (withCond) {
+    if ((condFile = tmpfile()) == NULL) {
+      printf("Unable to create a temporary file. Dying\n");
+      exit(-1);
+    }
+    setvbuf(condFile, NULL, _IOFBF, TRACECVT_IO_BUFFER_SIZE);
+  }
+
+  CBP_NATIVE_HEADER header;
+  memset(&header, 0, sizeof(header));
+  WriteOrDie(&header, sizeof(header), out);
+
+  if (withFull) {
+    header.recordOffset = AlignOutput(out);
+  }
+
+  CBP_NATIVE_RECORD rec;
+  memset(&rec, 0, sizeof(rec));
+
+  while (tracer->GetNextRecord(trace)) {
+    if (withFull) {
+      rec.PC           = trace->PC;
+      rec.branchTarget = trace->branchTarget;
+      rec.opType       = trace->opType;
+      rec.branchTaken  = trace->branchTaken;
+      WriteOrDie(&rec, sizeof(rec), out);
+      header.numRecords++;
+    }
+
+    if (withCond && trace->opType == OPTYPE_BRANCH_COND) {
+      CBP_NATIVE_COND_RECORD cond = {trace->PC, trace->branchTarget};
+      WriteOrDie(&cond, sizeof(cond), condFile);
+
+      UINT64 n = tracer->GetNumCondBranch() - 1;
+      if (n % 8 == 0) {
+        condTaken.push_back(0);
+      }
+      condTaken.back() |= trace->branchTaken << (n % 8);
+    }
+  }
+
+  if (withCond) {
+    header.condOffset = AlignOutput(out);
+
+    std::vector<char> buf(TRACECVT_IO_BUFFER_SIZE);
+    size_t n;
+    rewind(condFile);
+    while ((n = fread(buf.data(), 1, buf.size(), condFile)) > 0) {
+      WriteOrDie(buf.data(), n, out);
+    }
+    fclose(condFile);
+
+    header.condTakenOffset = AlignOutput(out);
+    WriteOrDie(condTaken.data(), condTaken.size(), out);
+  }
+
+  memcpy(header.magic, TRACE_NATIVE_MAGIC, sizeof(header.magic));
+  header.version       = TRACE_NATIVE_VERSION;
+  header.recordSize    = sizeof(CBP_NATIVE_RECORD);
+  header.numInst       = tracer->GetNumInst();
+  header.numCondBranch = tracer->GetNumCondBranch();
+
+  rewind(out);
+  WriteOrDie(&header, sizeof(header), out);
+  if (fclose(out) != 0) {
+    printf("Write to the native trace failed. Dying\n");
+    exit(-1);
+  }
+
+  printf("\nNUM_INSTRUCTIONS     \t : %10llu",   tracer->GetNumInst());
+  printf("\nNUM_CONDITIONAL_BR   \t : %10llu",   tracer->GetNumCondBranch());
+  printf("\n\n");
+
+  delete tracer;
+}
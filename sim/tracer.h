@@ -1,6 +1,7 @@
 #ifndef _TRACER_H_
 #define _TRACER_H_
 
+#include <zlib.h>
 #include "utils.h"
 
 /////////////////////////////////////////
@@ -22,6 +23,55 @@ typedef enum {
 /////////////////////////////////////////
 /////////////////////////////////////////
 
+// On-disk record: PC(4) branchTarget(4) opType(1) branchTaken(1)
+#define TRACE_RECORD_SIZE        10
+
+// The compressed trace is read in large chunks and inflated in-process
+// into a big output buffer, so records are decoded straight from memory.
+#define TRACE_INPUT_BUFFER_SIZE  (1 << 20)
+#define TRACE_OUTPUT_BUFFER_SIZE (1 << 22)
+
+/////////////////////////////////////////
+/////////////////////////////////////////
+
+// Native trace format (written by tracecvt): a header followed by a
+// fixed-stride record array and, optionally, a section holding only the
+// conditional branches. Sections start on TRACE_NATIVE_ALIGN boundaries
+// so the file can be mmapped and iterated in place.
+#define TRACE_NATIVE_MAGIC   "CBP4BIN"
+#define TRACE_NATIVE_VERSION 1
+#define TRACE_NATIVE_ALIGN   64
+
+// Pseudo trace name prefix for the synthetic generator (synthgen.h)
+#define TRACE_SYNTH_PREFIX   "synth:"
+
+struct CBP_NATIVE_HEADER {
+  char   magic[8];
+  UINT32 version;
+  UINT32 recordSize;      // stride of the full record section
+  UINT64 numInst;         // instructions in the source trace
+  UINT64 numCondBranch;   // conditional branches in the source trace
+  UINT64 recordOffset;    // full record section, 0 if absent
+  UINT64 numRecords;
+  UINT64 condOffset;      // conditional branch PC/target section, 0 if absent
+  UINT64 condTakenOffset; // one taken bit per conditional branch
+};
+
+struct CBP_NATIVE_RECORD {
+  UINT32        PC;
+  UINT32        branchTarget;
+  unsigned char opType;
+  unsigned char branchTaken;
+  unsigned char pad[2];
+};
+
+// Direction lives in the taken bitmap, so a conditional branch costs 8
+// bytes plus one bit.
+struct CBP_NATIVE_COND_RECORD {
+  UINT32 PC;
+  UINT32 branchTarget;
+};
+
 class CBP_TRACE_RECORD{
   public:
   UINT32   PC;
@@ -41,23 +91,68 @@ class CBP_TRACE_RECORD{
 /////////////////////////////////////////
 /////////////////////////////////////////
 
+class SYNTH_GEN;
+
 class CBP_TRACER{
  private:
   FILE *traceFile;
+  bool  isNative;
+
+  // "synth:..." traces: records come from the generator, no file
+  SYNTH_GEN *synth;
+
+  // native traces: the whole file is mapped read-only
+  unsigned char           *mapBase;
+  size_t                   mapSize;
+  const CBP_NATIVE_RECORD *nativeRecords;
+  UINT64                   numNativeRecords;
+  UINT64                   nextNativeRecord;
+
+  // conditional-branch-only replay: non-branch records are never seen,
+  // numInst comes from the header instead
+  bool                          condOnly;
+  const CBP_NATIVE_COND_RECORD *condRecords;
+  const unsigned char          *condTaken;
+
+  z_stream       stream;
+  unsigned char *inBuf;   // compressed bytes read from traceFile
+  unsigned char *outBuf;  // decompressed records
+  UINT32         outHead; // next unread byte in outBuf
+  UINT32         outTail; // end of valid bytes in outBuf
+  bool           inputDone;
+  bool           memberOpen; // inside a gzip member whose end is not seen yet
 
   UINT64 numInst;        
   UINT64 numCondBranch;
 
   UINT64 lastHeartBeat;
+  bool   heartBeat;      // print progress dots
 
  public:
-  CBP_TRACER(char *traceFileName);
+  CBP_TRACER(char *traceFileName, bool condOnlyReplay=false);
+  ~CBP_TRACER();
+  // owns the file, the zlib stream, its buffers and the mapping
+  CBP_TRACER(const CBP_TRACER &) = delete;
+  CBP_TRACER &operator=(const CBP_TRACER &) = delete;
 
   bool   GetNextRecord(CBP_TRACE_RECORD *record);  
   UINT64 GetNumInst(){ return numInst; }
   UINT64 GetNumCondBranch(){ return numCondBranch; }
+  bool   IsCondOnly(){ return condOnly; }
+  void   SetHeartBeat(bool on){ heartBeat = on; }
+
+  // Split decoding for predictor -pipeline: ReadRawRecords() inflates
+  // up to maxRecords undecoded records into buf and returns how many it
+  // read (0 at the end), ParseRawRecord() decodes one of them, possibly
+  // on another thread. Neither updates the trace stats. Compressed
+  // traces only.
+  bool   IsCompressed(){ return !isNative && !synth; }
+  UINT32 ReadRawRecords(unsigned char *buf, UINT32 maxRecords);
+  static void ParseRawRecord(const unsigned char *raw, CBP_TRACE_RECORD *rec);
 
  private:
+  void   MapNativeTrace(char *traceFileName, bool condOnlyReplay);
+  bool   RefillBuffer();
   void   CheckHeartBeat();
 };
 